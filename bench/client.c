@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+
+/*
+ * Synthetic xdg-shell clients for the benchmark target. Opens up to N
+ * toplevels and churns them through map, fullscreen, resize, retag (over
+ * the WM_IPC socket when it is set) and close, waiting after every step
+ * until the compositor answered with configures and the new buffers have
+ * been committed.
+ */
+
+#define LENGTH(X) (sizeof X / sizeof X[0])
+
+enum { OpMap, OpFullscreen, OpResize, OpRetag, OpClose, NUM_OPS };
+
+static const char *op_names[] = {
+	[OpMap] = "map",
+	[OpFullscreen] = "fullscreen",
+	[OpResize] = "resize",
+	[OpRetag] = "retag",
+	[OpClose] = "close",
+};
+
+struct window {
+	struct wl_surface *surface;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *toplevel;
+	int width, height; // last configured size, 0 lets us pick
+	int pending_width, pending_height;
+	int configured; // acked the last configure and committed a buffer for it
+	int fullscreen;
+};
+
+static struct wl_display *display;
+static struct wl_compositor *compositor;
+static struct wl_shm *shm;
+static struct xdg_wm_base *wm_base;
+static int ipc_fd = -1;
+
+static struct window *windows;
+static size_t nwindows, maxwindows;
+
+static struct {
+	unsigned long count;
+	double total, max; // ms
+	double *samples;
+} ops[NUM_OPS];
+
+static void die(const char *msg) {
+	fprintf(stderr, "wm-bench-client: %s\n", msg);
+	exit(1);
+}
+
+static double now_ms(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void buffer_release(void *data, struct wl_buffer *buffer) {
+	wl_buffer_destroy(buffer);
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = buffer_release,
+};
+
+static struct wl_buffer *buffer_create(int width, int height) {
+	struct wl_shm_pool *pool;
+	struct wl_buffer *buffer;
+	int fd, stride = width * 4, size = stride * height;
+	uint32_t *pixels;
+
+	if ((fd = memfd_create("wm-bench", MFD_CLOEXEC)) < 0 || ftruncate(fd, size) < 0)
+		die("cannot allocate buffer");
+	pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pixels == MAP_FAILED)
+		die("cannot map buffer");
+	// Opaque, so the compositor may take the fullscreen fast path
+	for (int i = 0; i < width * height; i++)
+		pixels[i] = 0xff336699;
+	munmap(pixels, size);
+
+	pool = wl_shm_create_pool(shm, fd, size);
+	buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+	wl_buffer_add_listener(buffer, &buffer_listener, NULL);
+	return buffer;
+}
+
+static void window_draw(struct window *w) {
+	struct wl_region *opaque;
+
+	opaque = wl_compositor_create_region(compositor);
+	wl_region_add(opaque, 0, 0, w->width, w->height);
+	wl_surface_set_opaque_region(w->surface, opaque);
+	wl_region_destroy(opaque);
+
+	wl_surface_attach(w->surface, buffer_create(w->width, w->height), 0, 0);
+	wl_surface_damage_buffer(w->surface, 0, 0, w->width, w->height);
+	wl_surface_commit(w->surface);
+}
+
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
+	struct window *w = data;
+
+	xdg_surface_ack_configure(xdg_surface, serial);
+	w->width = w->pending_width ? w->pending_width : 640;
+	w->height = w->pending_height ? w->pending_height : 480;
+	window_draw(w);
+	w->configured = 1;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = xdg_surface_configure,
+};
+
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel,
+		int32_t width, int32_t height, struct wl_array *states) {
+	struct window *w = data;
+
+	w->pending_width = width;
+	w->pending_height = height;
+}
+
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel) {
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+	.configure = toplevel_configure,
+	.close = toplevel_close,
+};
+
+static void wm_base_ping(void *data, struct xdg_wm_base *base, uint32_t serial) {
+	xdg_wm_base_pong(base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = wm_base_ping,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	if (!strcmp(interface, wl_compositor_interface.name)) {
+		compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+	} else if (!strcmp(interface, wl_shm_interface.name)) {
+		shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	} else if (!strcmp(interface, xdg_wm_base_interface.name)) {
+		wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+		xdg_wm_base_add_listener(wm_base, &wm_base_listener, NULL);
+	}
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name) {
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_global,
+	.global_remove = registry_global_remove,
+};
+
+static void window_open(struct window *w) {
+	memset(w, 0, sizeof(*w));
+	w->surface = wl_compositor_create_surface(compositor);
+	w->xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, w->surface);
+	xdg_surface_add_listener(w->xdg_surface, &xdg_surface_listener, w);
+	w->toplevel = xdg_surface_get_toplevel(w->xdg_surface);
+	xdg_toplevel_add_listener(w->toplevel, &toplevel_listener, w);
+	xdg_toplevel_set_app_id(w->toplevel, "wm-bench");
+	xdg_toplevel_set_title(w->toplevel, "wm-bench");
+	wl_surface_commit(w->surface);
+}
+
+static void window_close(struct window *w) {
+	xdg_toplevel_destroy(w->toplevel);
+	xdg_surface_destroy(w->xdg_surface);
+	wl_surface_destroy(w->surface);
+}
+
+static void ipc_connect(void) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	const char *path = getenv("WM_IPC");
+
+	if (!path || strlen(path) >= sizeof(addr.sun_path))
+		return;
+	strcpy(addr.sun_path, path);
+	if ((ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+			|| connect(ipc_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		die("cannot connect to WM_IPC");
+}
+
+static void ipc_request(const char *request) {
+	char c;
+
+	if (write(ipc_fd, request, strlen(request)) < 0)
+		die("lost the IPC socket");
+	// Wait for the "ok" (or error) line, the status lines only go to
+	// subscribers
+	do {
+		if (read(ipc_fd, &c, 1) != 1)
+			die("lost the IPC socket");
+	} while (c != '\n');
+}
+
+static void settle(void) {
+	// Arranges run from an idle source after the request that caused them,
+	// the second roundtrip collects the configures they sent
+	size_t i;
+	int pending;
+
+	do {
+		if (wl_display_roundtrip(display) < 0 || wl_display_roundtrip(display) < 0)
+			die("lost the compositor");
+		pending = 0;
+		for (i = 0; i < nwindows; i++)
+			pending |= !windows[i].configured;
+	} while (pending);
+}
+
+static void op_run(int op) {
+	struct window *w;
+	double start = now_ms(), ms;
+
+	switch (op) {
+	case OpMap:
+		if (nwindows == maxwindows)
+			return;
+		window_open(&windows[nwindows++]);
+		break;
+	case OpFullscreen:
+		if (!nwindows)
+			return;
+		w = &windows[rand() % nwindows];
+		if ((w->fullscreen = !w->fullscreen))
+			xdg_toplevel_set_fullscreen(w->toplevel, NULL);
+		else
+			xdg_toplevel_unset_fullscreen(w->toplevel);
+		w->configured = 0;
+		break;
+	case OpResize:
+		if (!nwindows)
+			return;
+		// Draw at a size the compositor did not ask for, it has to lay the
+		// window out again
+		w = &windows[rand() % nwindows];
+		w->width = (w->pending_width ? w->pending_width : 640) / 2 + 1;
+		w->height = (w->pending_height ? w->pending_height : 480) / 2 + 1;
+		window_draw(w);
+		break;
+	case OpRetag: {
+		// Moves the focused window to another tag of its monitor
+		char request[32];
+
+		snprintf(request, sizeof(request), "tag %u\n", 1u << rand() % 9);
+		ipc_request(request);
+		break;
+	}
+	case OpClose:
+		// Keep the window count near the target
+		if (nwindows < maxwindows)
+			return;
+		w = &windows[rand() % nwindows];
+		window_close(w);
+		*w = windows[--nwindows];
+		// Moving the struct breaks the listener data pointers
+		for (size_t i = 0; i < nwindows; i++) {
+			wl_proxy_set_user_data((struct wl_proxy *)windows[i].xdg_surface, &windows[i]);
+			wl_proxy_set_user_data((struct wl_proxy *)windows[i].toplevel, &windows[i]);
+		}
+		break;
+	}
+	settle();
+
+	ms = now_ms() - start;
+	ops[op].samples[ops[op].count++] = ms;
+	ops[op].total += ms;
+	if (ms > ops[op].max)
+		ops[op].max = ms;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+static void report(double elapsed) {
+	unsigned long total = 0;
+	size_t i;
+
+	for (i = 0; i < NUM_OPS; i++) {
+		if (!ops[i].count)
+			continue;
+		total += ops[i].count;
+		qsort(ops[i].samples, ops[i].count, sizeof(double), cmp_double);
+		printf("op %-10s n=%-6lu avg=%.3fms p50=%.3fms p99=%.3fms max=%.3fms\n",
+				op_names[i], ops[i].count, ops[i].total / ops[i].count,
+				ops[i].samples[ops[i].count / 2],
+				ops[i].samples[ops[i].count * 99 / 100], ops[i].max);
+	}
+	printf("throughput %.1f ops/s (%lu ops, %zu windows, %.2fs)\n",
+			total / (elapsed / 1e3), total, maxwindows, elapsed / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long iterations = 2000, i;
+	double start;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:i:")) != -1) {
+		if (c == 'n')
+			maxwindows = strtoul(optarg, NULL, 10);
+		else if (c == 'i')
+			iterations = strtoul(optarg, NULL, 10);
+		else
+			die("usage: wm-bench-client [-n windows] [-i iterations]");
+	}
+	if (!maxwindows)
+		maxwindows = 50;
+
+	if (!(display = wl_display_connect(NULL)))
+		die("cannot connect to the compositor");
+	wl_registry_add_listener(wl_display_get_registry(display), &registry_listener, NULL);
+	wl_display_roundtrip(display);
+	if (!compositor || !shm || !wm_base)
+		die("compositor lacks wl_compositor, wl_shm or xdg_wm_base");
+	ipc_connect();
+
+	windows = calloc(maxwindows, sizeof(*windows));
+	for (i = 0; i < LENGTH(ops); i++)
+		ops[i].samples = calloc(iterations + maxwindows, sizeof(double));
+	if (!windows)
+		die("out of memory");
+
+	// Fill up first, the churn then runs at the full window count
+	start = now_ms();
+	while (nwindows < maxwindows)
+		op_run(OpMap);
+	for (i = 0; i < iterations; i++)
+		op_run(i % 2 ? OpFullscreen + rand() % (ipc_fd < 0 ? 2 : 3) : (i / 2) % 2 ? OpClose : OpMap);
+	report(now_ms() - start);
+
+	while (nwindows)
+		window_close(&windows[--nwindows]);
+	wl_display_roundtrip(display);
+	wl_display_disconnect(display);
+	return 0;
+}
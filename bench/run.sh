@@ -0,0 +1,39 @@
+#!/bin/sh
+# Starts the compositor on the headless backend with the pixman renderer and
+# drives it with synthetic clients, see bench/client.c.
+#
+#   WINDOWS    toplevels kept open (default 50)
+#   ITERATIONS churn steps after the initial fill (default 2000)
+#   OUTPUTS    headless outputs (default 2)
+
+WINDOWS=${WINDOWS:-50}
+ITERATIONS=${ITERATIONS:-2000}
+OUTPUTS=${OUTPUTS:-2}
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+XDG_RUNTIME_DIR=$dir WLR_BACKENDS=headless WLR_RENDERER=pixman \
+	WLR_HEADLESS_OUTPUTS=$OUTPUTS WLR_LIBINPUT_NO_DEVICES=1 WM_PROFILE=1 \
+	bin/dwl >/dev/null 2>"$dir/log" &
+pid=$!
+
+i=0
+while ! ls "$dir"/wayland-? >/dev/null 2>&1; do
+	if [ $((i += 1)) -gt 50 ] || ! kill -0 $pid 2>/dev/null; then
+		echo "bench: compositor did not start" >&2
+		tail "$dir/log" >&2
+		exit 1
+	fi
+	sleep 0.1
+done
+socket=$(basename "$(ls "$dir"/wayland-? | head -n 1)")
+
+XDG_RUNTIME_DIR=$dir WAYLAND_DISPLAY=$socket WM_IPC=$dir/wm.$socket.sock \
+	bin/wm-bench-client -n "$WINDOWS" -i "$ITERATIONS"
+status=$?
+
+kill -TERM $pid
+wait $pid
+grep '^prof ' "$dir/log"
+exit $status
@@ -11,24 +11,22 @@ static void quit(void) {
 }
 
 static void handlesig(int signo) {
-	if (signo == SIGCHLD) {
-		while (waitpid(-1, NULL, WNOHANG) > 0);
-	} else if (signo == SIGINT || signo == SIGTERM) {
+	if (signo == SIGINT || signo == SIGTERM) {
 		quit();
 	}
 }
 
 void setup(void) {
-	int sig[4] = {SIGCHLD, SIGINT, SIGTERM, SIGPIPE};
+	int sig[3] = {SIGINT, SIGTERM, SIGPIPE};
 	struct sigaction sa = {.sa_flags = SA_RESTART, .sa_handler = handlesig};
 
-	server = malloc(sizeof(struct server));
+	server = calloc(1, sizeof(struct server));
 	if (!server)
 		die("Failed to allocate server");
 
 	sigemptyset(&sa.sa_mask);
 
-	for (int i = 0; i < 4; i++) {
+	for (int i = 0; i < 3; i++) {
 		sigaction(sig[i], &sa, NULL);
 	}
 
@@ -64,6 +62,15 @@ void setup(void) {
 	 * clients from the Unix socket, manging Wayland globals, and so on. */
 	server->display = wl_display_create();
 
+	/* Children are reaped and their stops tracked from the event loop */
+	procstate_init();
+	latency_init();
+	prof_init();
+	state_init();
+	bindings_init();
+	rules_reload();
+	keymap_init();
+
 	/* The backend is a wlroots feature which abstracts the underlying input and
 	 * output hardware. The autocreate option will choose the most suitable
 	 * backend based on the current environment, such as opening an X11 window
@@ -142,7 +149,7 @@ void setup(void) {
 	server->layer_shell = wlr_layer_shell_v1_create(server->display);
 	wl_signal_add(&server->layer_shell->events.new_surface, &server->new_layer_shell_surface);
 
-	server->xdg_shell = wlr_xdg_shell_create(server->display, 4);
+	server->xdg_shell = wlr_xdg_shell_create(server->display, XDG_SHELL_VERSION);
 	wl_signal_add(&server->xdg_shell->events.new_surface, &server->new_xdg_surface);
 
 	server->input_inhibit_mgr = wlr_input_inhibit_manager_create(server->display);
@@ -174,6 +181,11 @@ void setup(void) {
 	server->cursor_mgr = wlr_xcursor_manager_create(NULL, 24);
 	setenv("XCURSOR_SIZE", "24", 1);
 
+	/* Raw, unaccelerated deltas for clients that ask for them (games,
+	 * 3D viewports), sent with every motion event even when the cursor
+	 * itself is only updated once per event loop iteration */
+	server->relative_pointer_mgr = wlr_relative_pointer_manager_v1_create(server->display);
+
 	/*
 	 * wlr_cursor *only* displays an image on screen. It does not move around
 	 * when the pointer moves. However, we can attach input devices to it, and
@@ -224,6 +236,7 @@ void run(void) {
 		die("startup: display_add_socket_auto");
 	setenv("WAYLAND_DISPLAY", socket, 1);
 	wlr_log(WLR_INFO, "Created socket %s", socket);
+	ipc_init(socket);
 
 	/* Start the backend. This will enumerate outputs and inputs, become the DRM
 	 * master, etc */
@@ -232,10 +245,9 @@ void run(void) {
 
 	wlr_log(WLR_INFO, "rubber ducky");
 
-	run_daemon("/usr/bin/foot --server", &server->processes, server->activation, server->seat);
-	//run_subprocess("/usr/bin/dbus-update-activation-environment --all");
-	//run_subprocess("/usr/bin/gentoo-pipewire-launcher");
-	run_child("/home/mynah/Documents/Programming/somebar/build/somebar", &server->processes, server->activation, server->seat);
+	// Launched from the event loop, see autostart.c
+	autostart_init(socket);
+	pool_init();
 
 	//printstatus();
 
@@ -261,6 +273,16 @@ void run(void) {
 
 void cleanup(void) {
 	wl_display_destroy_clients(server->display);
+	procstate_finish();
+	latency_finish();
+	prof_dump(stderr);
+	autostart_finish();
+	pool_finish();
+	ipc_finish();
+	state_finish();
+	bindings_finish();
+	rules_finish();
+	keymap_finish();
 	wlr_backend_destroy(server->backend);
 	wlr_scene_node_destroy(&server->scene->tree.node);
 	wlr_renderer_destroy(server->renderer);
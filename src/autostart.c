@@ -0,0 +1,241 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+
+/*
+ * Programs started with the compositor. Entries are started from the event
+ * loop as soon as the entry they come after is ready, all others at once,
+ * and nothing waits on them. An entry is ready once it was spawned, or, if
+ * it names a ready file, once that file shows up in $XDG_RUNTIME_DIR ("%s"
+ * in it stands for $WAYLAND_DISPLAY). Entries that restart are started
+ * again after they exit, waiting twice as long each time they die young.
+ */
+
+#define AUTOSTART_READY_TIMEOUT_MS 5000 // dependents start anyway after this
+#define AUTOSTART_BACKOFF_MS 500
+#define AUTOSTART_BACKOFF_MAX_MS 30000
+#define AUTOSTART_STABLE_MS 10000 // running this long resets the backoff
+
+static const struct autostart {
+	const char *name;
+	const char *cmd;
+	const char *after; // name of the entry that has to be ready first
+	const char *ready; // file in $XDG_RUNTIME_DIR that marks it ready
+	int restart;
+	int bar; // reads the status lines on our stdout
+} autostart[] = {
+	{"foot", "/usr/bin/foot --server", .ready = "foot-%s.sock", .restart = 1},
+	//{"dbus-env", "/usr/bin/dbus-update-activation-environment --all"},
+	//{"pipewire", "/usr/bin/gentoo-pipewire-launcher", .after = "dbus-env"},
+	{"bar", "/home/mynah/Documents/Programming/somebar/build/somebar", .restart = 1, .bar = 1},
+};
+
+enum { AsWaiting, AsStarted, AsReady };
+
+static struct {
+	int state;
+	struct process *process;
+	struct wl_event_source *timer; // restart backoff
+	struct wl_event_source *ready_timer; // from the first start, restarts do not move it
+	char *ready; // full path of the ready file
+	unsigned int failures;
+	uint64_t started; // ms
+} entries[LENGTH(autostart)];
+
+static struct timespec start_time;
+static struct wl_event_source *start_idle, *inotify_source;
+static int inotify_fd = -1;
+
+static void autostart_start(size_t i);
+
+static uint64_t now_ms(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+
+static uint64_t since_start_ms(void) {
+	return now_ms() - (start_time.tv_sec * 1000ull + start_time.tv_nsec / 1000000);
+}
+
+static void autostart_ready(size_t i) {
+	size_t j;
+
+	if (entries[i].state == AsReady)
+		return;
+	entries[i].state = AsReady;
+	if (entries[i].ready_timer)
+		wl_event_source_timer_update(entries[i].ready_timer, 0);
+	wlr_log(WLR_INFO, "autostart: %s ready after %llu ms", autostart[i].name,
+			(unsigned long long)since_start_ms());
+
+	for (j = 0; j < LENGTH(autostart); j++)
+		if (entries[j].state == AsWaiting && autostart[j].after
+				&& !strcmp(autostart[j].after, autostart[i].name))
+			autostart_start(j);
+}
+
+static int autostart_timeout(void *data) {
+	// Backoff over
+	size_t i = (struct autostart *)data - autostart;
+
+	if (!entries[i].process && autostart[i].restart)
+		autostart_start(i);
+	return 0;
+}
+
+static int autostart_ready_timeout(void *data) {
+	size_t i = (struct autostart *)data - autostart;
+
+	if (entries[i].state == AsStarted) {
+		wlr_log(WLR_ERROR, "autostart: %s not ready after %d ms, going on without it",
+				autostart[i].name, AUTOSTART_READY_TIMEOUT_MS);
+		autostart_ready(i);
+	}
+	return 0;
+}
+
+static void autostart_exited(struct process *process, int status, void *data) {
+	size_t i = (struct autostart *)data - autostart;
+	int delay = AUTOSTART_BACKOFF_MS;
+	unsigned int n;
+
+	entries[i].process = NULL;
+	if (!autostart[i].restart) {
+		// Done before it got ready, its dependents go ahead
+		if (entries[i].state == AsStarted)
+			autostart_ready(i);
+		return;
+	}
+
+	if (now_ms() - entries[i].started >= AUTOSTART_STABLE_MS)
+		entries[i].failures = 0;
+	for (n = entries[i].failures++; n && delay < AUTOSTART_BACKOFF_MAX_MS; n--)
+		delay *= 2;
+	delay = MIN(delay, AUTOSTART_BACKOFF_MAX_MS);
+	wlr_log(WLR_INFO, "autostart: restarting %s in %d ms", autostart[i].name, delay);
+	wl_event_source_timer_update(entries[i].timer, delay);
+}
+
+static void autostart_start(size_t i) {
+	const struct autostart *a = &autostart[i];
+
+	entries[i].process = a->bar
+		? run_child(a->cmd, &server->processes, server->activation, server->seat)
+		: spawn(a->cmd, -1, STDERR_FILENO, &server->processes, server->activation, server->seat);
+	entries[i].started = now_ms();
+	if (!entries[i].process) {
+		// Cannot even be spawned, do not hold up its dependents
+		autostart_ready(i);
+		return;
+	}
+	entries[i].process->exited = autostart_exited;
+	entries[i].process->data = (void *)a;
+	if (a->bar)
+		status_resend();
+
+	// Restarts of a ready entry do not become ready again, their
+	// dependents already run
+	if (entries[i].state == AsReady)
+		return;
+	if (!entries[i].ready || access(entries[i].ready, F_OK) == 0) {
+		autostart_ready(i);
+		return;
+	}
+	// Crashing and restarting before it got ready still runs out the
+	// deadline of the first start
+	if (entries[i].state == AsWaiting)
+		wl_event_source_timer_update(entries[i].ready_timer, AUTOSTART_READY_TIMEOUT_MS);
+	entries[i].state = AsStarted;
+}
+
+static int autostart_inotify(int fd, uint32_t mask, void *data) {
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	size_t i;
+
+	// Whatever was created, looking at the few files we wait for is cheaper
+	// than matching the names
+	while (read(fd, buf, sizeof(buf)) > 0);
+	for (i = 0; i < LENGTH(autostart); i++)
+		if (entries[i].state == AsStarted && entries[i].ready
+				&& access(entries[i].ready, F_OK) == 0)
+			autostart_ready(i);
+	return 0;
+}
+
+static void autostart_run(void *data) {
+	size_t i, j;
+
+	start_idle = NULL;
+	for (i = 0; i < LENGTH(autostart); i++) {
+		for (j = 0; autostart[i].after && j < LENGTH(autostart); j++)
+			if (!strcmp(autostart[i].after, autostart[j].name))
+				break;
+		if (autostart[i].after && j == LENGTH(autostart))
+			wlr_log(WLR_ERROR, "autostart: %s comes after unknown %s, starting it now",
+					autostart[i].name, autostart[i].after);
+		if (!autostart[i].after || j == LENGTH(autostart))
+			autostart_start(i);
+	}
+}
+
+void autostart_init(const char *display) {
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	char name[PATH_MAX];
+	size_t i, len;
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	for (i = 0; i < LENGTH(autostart); i++) {
+		entries[i].timer = wl_event_loop_add_timer(loop, autostart_timeout, (void *)&autostart[i]);
+		entries[i].ready_timer = wl_event_loop_add_timer(loop, autostart_ready_timeout,
+				(void *)&autostart[i]);
+		if (!autostart[i].ready)
+			continue;
+		snprintf(name, sizeof(name), autostart[i].ready, display);
+		len = strlen(dir) + strlen(name) + 2;
+		entries[i].ready = ecalloc(1, len);
+		snprintf(entries[i].ready, len, "%s/%s", dir, name);
+	}
+
+	if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0
+			|| inotify_add_watch(inotify_fd, dir, IN_CREATE | IN_MOVED_TO) < 0)
+		wlr_log_errno(WLR_ERROR, "autostart: cannot watch %s, "
+				"entries will only wait for the timeout", dir);
+	else
+		inotify_source = wl_event_loop_add_fd(loop, inotify_fd, WL_EVENT_READABLE,
+				autostart_inotify, NULL);
+
+	// Started once the event loop runs, the first frame does not wait
+	start_idle = wl_event_loop_add_idle(loop, autostart_run, NULL);
+}
+
+void autostart_finish(void) {
+	size_t i;
+
+	if (start_idle)
+		wl_event_source_remove(start_idle);
+	if (inotify_source)
+		wl_event_source_remove(inotify_source);
+	if (inotify_fd >= 0)
+		close(inotify_fd);
+	for (i = 0; i < LENGTH(autostart); i++) {
+		// The children outlive us
+		if (entries[i].process)
+			entries[i].process->exited = NULL;
+		if (entries[i].timer)
+			wl_event_source_remove(entries[i].timer);
+		if (entries[i].ready_timer)
+			wl_event_source_remove(entries[i].ready_timer);
+		free(entries[i].ready);
+	}
+}
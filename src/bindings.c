@@ -0,0 +1,512 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+
+/*
+ * Key and mouse bindings, read from $WM_BINDINGS, else
+ * $XDG_CONFIG_HOME/wm/bindings or ~/.config/wm/bindings, else the defaults
+ * below. One binding per line:
+ *
+ *   key <mods>+<keysym> <action> [argument]
+ *   button <mods>+<button> <action> [argument]
+ *
+ * Modifiers are Mod (MODKEY), Shift, Ctrl, Alt and Logo, keysyms are xkb
+ * names as produced with the modifiers held (Mod+Shift+exclam), buttons
+ * are left, right, middle, side, extra or a number. Lines starting with #
+ * are comments. See actions[] for what can be bound. The file is read
+ * again, together with the rules file, on SIGHUP, the reload action and
+ * the IPC reload request; a file with errors is rejected as a whole and
+ * the bindings in use are kept.
+ *
+ * Modifiers in a file have to match exactly, except that Shift held on
+ * top is dropped again when that finds nothing. The defaults only ask for
+ * their modifiers to be held, as the hardcoded bindings they replace did:
+ * Mod+Ctrl+j still focuses and Ctrl+side still runs previous. Of the
+ * bindings the held modifiers would allow, the one asking for the most wins.
+ *
+ * Bindings sit in an open addressing hash table keyed by modifiers and
+ * keysym or button, so dispatch costs the same however many there are.
+ */
+
+#define BIND_BUTTON (1u << 31) // in the modifiers of button bindings
+#define BIND_MODS (WLR_MODIFIER_SHIFT | WLR_MODIFIER_CTRL | WLR_MODIFIER_ALT | WLR_MODIFIER_LOGO)
+
+enum { ArgNone, ArgInt, ArgTag, ArgDir, ArgCmd };
+
+union arg {
+	int i;
+	uint32_t ui;
+	char *cmd;
+};
+
+struct action {
+	const char *name;
+	void (*fn)(const union arg *arg);
+	int type;
+};
+
+struct binding {
+	uint64_t key; // 0 for a free slot
+	const struct action *action;
+	union arg arg;
+};
+
+struct table {
+	struct binding *slots;
+	size_t mask; // slot count - 1
+	size_t n;
+};
+
+static void do_spawn(const union arg *arg) {
+	// Our stdout is the status pipe of the bar
+	process_place_here(spawn(arg->cmd, -1, STDERR_FILENO, &server->processes,
+			server->activation, server->seat));
+}
+
+static void do_pool(const union arg *arg) {
+	pool_take(arg->cmd);
+}
+
+static void do_view(const union arg *arg) {
+	view(arg->ui);
+}
+
+static void do_tagview(const union arg *arg) {
+	tag(arg->ui);
+	view(arg->ui);
+}
+
+static void do_focus(const union arg *arg) {
+	arg->i > 0 ? focus_next() : focus_prev();
+}
+
+static void do_incnmaster(const union arg *arg) {
+	incnmaster(arg->i);
+}
+
+static void do_togglefullscreen(const union arg *arg) {
+	togglefullscreen();
+}
+
+static void do_monitor_focus(const union arg *arg) {
+	monitor_focus(arg->i);
+}
+
+static void do_monitor_tag(const union arg *arg) {
+	// The client moves and focus follows it
+	monitor_tag(arg->i);
+	monitor_focus(arg->i);
+}
+
+static void do_kill(const union arg *arg) {
+	kill_focused_client();
+}
+
+static void do_quit(const union arg *arg) {
+	wl_display_terminate(server->display);
+}
+
+static void do_reload(const union arg *arg) {
+	bindings_reload();
+	rules_reload();
+}
+
+static const struct action actions[] = {
+	{"spawn", do_spawn, ArgCmd}, // the rest of the line, run with sh -c
+	{"pool", do_pool, ArgCmd}, // name of a warm pool program, see pool.c
+	{"view", do_view, ArgTag}, // tag number, or prev for the previous tagset
+	{"tagview", do_tagview, ArgTag},
+	{"focus", do_focus, ArgInt}, // 1 for the next client, -1 for the previous
+	{"incnmaster", do_incnmaster, ArgInt},
+	{"togglefullscreen", do_togglefullscreen, ArgNone},
+	{"monitor_focus", do_monitor_focus, ArgDir}, // left, right, up or down
+	{"monitor_tag", do_monitor_tag, ArgDir},
+	{"kill", do_kill, ArgNone},
+	{"quit", do_quit, ArgNone},
+	{"reload", do_reload, ArgNone},
+};
+
+static const char *const default_bindings[] = {
+	"key Mod+d spawn /usr/bin/bemenu-run",
+	"key Mod+Return pool terminal",
+	"key Mod+Left focus 1",
+	"key Mod+j focus 1",
+	"key Mod+Right focus -1",
+	"key Mod+k focus -1",
+	"key Mod+Up incnmaster 1",
+	"key Mod+i incnmaster 1",
+	"key Mod+Down incnmaster -1",
+	"key Mod+u incnmaster -1",
+	"key Mod+Tab view prev",
+	"key Mod+f togglefullscreen",
+	"key Mod+comma monitor_focus left",
+	"key Mod+period monitor_focus right",
+	"key Mod+1 view 1",
+	"key Mod+2 view 2",
+	"key Mod+3 view 3",
+	"key Mod+4 view 4",
+	"key Mod+5 view 5",
+	"key Mod+6 view 6",
+	"key Mod+7 view 7",
+	"key Mod+8 view 8",
+	"key Mod+9 view 9",
+	"key Mod+Shift+exclam tagview 1",
+	"key Mod+Shift+at tagview 2",
+	"key Mod+Shift+numbersign tagview 3",
+	"key Mod+Shift+dollar tagview 4",
+	"key Mod+Shift+percent tagview 5",
+	"key Mod+Shift+asciicircum tagview 6",
+	"key Mod+Shift+ampersand tagview 7",
+	"key Mod+Shift+asterisk tagview 8",
+	"key Mod+Shift+parenleft tagview 9",
+	"key Mod+Shift+E quit",
+	"key Mod+Shift+Q kill",
+	"key Mod+Shift+less monitor_tag left",
+	"key Mod+Shift+greater monitor_tag right",
+	"button Mod+side spawn /usr/bin/playerctl play-pause",
+	"button Shift+extra spawn /usr/bin/wpctl set-volume @DEFAULT_AUDIO_SINK@ 2%+",
+	"button Shift+side spawn /usr/bin/wpctl set-volume @DEFAULT_AUDIO_SINK@ 2%-",
+	"button extra spawn /usr/bin/playerctl next",
+	"button side spawn /usr/bin/playerctl previous",
+};
+
+static const struct {
+	const char *name;
+	uint32_t mod;
+} mod_names[] = {
+	{"Mod", MODKEY},
+	{"Shift", WLR_MODIFIER_SHIFT},
+	{"Ctrl", WLR_MODIFIER_CTRL},
+	{"Alt", WLR_MODIFIER_ALT},
+	{"Logo", WLR_MODIFIER_LOGO},
+};
+
+static const struct {
+	const char *name;
+	uint32_t button;
+} button_names[] = {
+	{"left", BTN_LEFT},
+	{"right", BTN_RIGHT},
+	{"middle", BTN_MIDDLE},
+	{"side", BTN_SIDE},
+	{"extra", BTN_EXTRA},
+};
+
+static struct table bindings;
+static int defaults; // bindings holds the defaults, see bindings_run()
+static struct wl_event_source *sighup_source;
+
+static size_t slot_of(const struct table *t, uint64_t key) {
+	size_t i = (key * 0x9e3779b97f4a7c15ull) >> 32 & t->mask;
+
+	while (t->slots[i].key && t->slots[i].key != key)
+		i = (i + 1) & t->mask;
+	return i;
+}
+
+static void table_free(struct table *t) {
+	size_t i;
+
+	for (i = 0; t->slots && i <= t->mask; i++)
+		if (t->slots[i].key && t->slots[i].action->type == ArgCmd)
+			free(t->slots[i].arg.cmd);
+	free(t->slots);
+	*t = (struct table){0};
+}
+
+static void table_grow(struct table *t) {
+	struct table old = *t;
+	size_t i;
+
+	t->mask = old.slots ? old.mask * 2 + 1 : 63;
+	t->slots = ecalloc(t->mask + 1, sizeof(*t->slots));
+	for (i = 0; old.slots && i <= old.mask; i++)
+		if (old.slots[i].key)
+			t->slots[slot_of(t, old.slots[i].key)] = old.slots[i];
+	free(old.slots);
+}
+
+static void table_add(struct table *t, const struct binding *b) {
+	// A later binding for the same combination replaces the earlier one
+	struct binding *slot;
+
+	if (!t->slots || (t->n + 1) * 2 > t->mask + 1)
+		table_grow(t);
+	slot = &t->slots[slot_of(t, b->key)];
+	if (slot->key) {
+		if (slot->action->type == ArgCmd)
+			free(slot->arg.cmd);
+	} else {
+		t->n++;
+	}
+	*slot = *b;
+}
+
+static const struct binding *table_find(const struct table *t, uint32_t mods, uint32_t code) {
+	const struct binding *b;
+
+	if (!t->n)
+		return NULL;
+	b = &t->slots[slot_of(t, (uint64_t)mods << 32 | code)];
+	return b->key ? b : NULL;
+}
+
+static const char *parse_combo(char *combo, int button, uint64_t *key) {
+	char *part, *next, *end;
+	uint32_t mods = button ? BIND_BUTTON : 0, code = 0;
+	size_t i;
+
+	for (part = combo; (next = strchr(part, '+')); part = next + 1) {
+		*next = '\0';
+		for (i = 0; i < LENGTH(mod_names); i++)
+			if (!strcmp(part, mod_names[i].name))
+				break;
+		if (i == LENGTH(mod_names))
+			return "unknown modifier";
+		mods |= mod_names[i].mod;
+	}
+
+	if (button) {
+		for (i = 0; i < LENGTH(button_names); i++)
+			if (!strcmp(part, button_names[i].name))
+				code = button_names[i].button;
+		if (!code && (!(code = strtoul(part, &end, 0)) || *end))
+			return "unknown button";
+	} else if ((code = xkb_keysym_from_name(part, XKB_KEYSYM_NO_FLAGS)) == XKB_KEY_NoSymbol) {
+		return "unknown keysym";
+	}
+	*key = (uint64_t)mods << 32 | code;
+	return NULL;
+}
+
+static const char *parse_arg(int type, char *arg, union arg *out) {
+	static const char *dirs[] = {
+		[WLR_DIRECTION_UP] = "up", [WLR_DIRECTION_DOWN] = "down",
+		[WLR_DIRECTION_LEFT] = "left", [WLR_DIRECTION_RIGHT] = "right",
+	};
+	char *end;
+	long n;
+	size_t i;
+
+	if (type == ArgNone)
+		return arg ? "unexpected argument" : NULL;
+	if (!arg)
+		return "missing argument";
+
+	switch (type) {
+	case ArgInt:
+		out->i = n = strtol(arg, &end, 0);
+		return *end ? "not a number" : NULL;
+	case ArgTag:
+		if (!strcmp(arg, "prev")) {
+			out->ui = 0;
+			return NULL;
+		}
+		n = strtol(arg, &end, 10);
+		if (*end || n < 1 || n > TAGCOUNT)
+			return "not a tag number";
+		out->ui = 1u << (n - 1);
+		return NULL;
+	case ArgDir:
+		for (i = 0; i < LENGTH(dirs); i++) {
+			if (dirs[i] && !strcmp(arg, dirs[i])) {
+				out->i = i;
+				return NULL;
+			}
+		}
+		return "not a direction";
+	case ArgCmd:
+		if (!(out->cmd = strdup(arg)))
+			die("strdup:");
+		return NULL;
+	}
+	return "bad argument";
+}
+
+static const char *parse_line(char *line, struct table *t) {
+	// Returns an error message or NULL, blank lines and comments are fine
+	char *kind, *combo, *name, *arg, *save;
+	struct binding b = {0};
+	const char *err;
+	size_t i;
+
+	line += strspn(line, " \t");
+	if (!*line || *line == '#')
+		return NULL;
+	kind = strtok_r(line, " \t", &save);
+	combo = strtok_r(NULL, " \t", &save);
+	name = strtok_r(NULL, " \t", &save);
+	if (!combo || !name)
+		return "expected key|button <combo> <action> [argument]";
+	// Commands keep their spaces
+	arg = save + strspn(save, " \t");
+	if (!*arg)
+		arg = NULL;
+
+	if (strcmp(kind, "key") && strcmp(kind, "button"))
+		return "expected key or button";
+	if ((err = parse_combo(combo, !strcmp(kind, "button"), &b.key)))
+		return err;
+	for (i = 0; i < LENGTH(actions); i++)
+		if (!strcmp(name, actions[i].name))
+			break;
+	if (i == LENGTH(actions))
+		return "unknown action";
+	b.action = &actions[i];
+	if (actions[i].type != ArgCmd && arg)
+		arg = strtok_r(arg, " \t", &save);
+	if ((err = parse_arg(b.action->type, arg, &b.arg)))
+		return err;
+	table_add(t, &b);
+	return NULL;
+}
+
+static char *bindings_path(void) {
+	const char *env;
+	char *path;
+	size_t len;
+
+	if ((env = getenv("WM_BINDINGS")))
+		return strdup(env);
+	if ((env = getenv("XDG_CONFIG_HOME")) && *env) {
+		len = strlen(env) + sizeof("/wm/bindings");
+		path = ecalloc(1, len);
+		snprintf(path, len, "%s/wm/bindings", env);
+		return path;
+	}
+	if ((env = getenv("HOME"))) {
+		len = strlen(env) + sizeof("/.config/wm/bindings");
+		path = ecalloc(1, len);
+		snprintf(path, len, "%s/.config/wm/bindings", env);
+		return path;
+	}
+	return NULL;
+}
+
+static int bindings_load_file(const char *path, struct table *t) {
+	// Returns 0 on success, -1 with errno set if the file cannot be read
+	// and -2 if it has errors
+	FILE *f;
+	char *line = NULL, *nl;
+	size_t size = 0;
+	const char *err;
+	int lineno = 0, ret = 0;
+
+	if (!(f = fopen(path, "r")))
+		return -1;
+	while (getline(&line, &size, f) >= 0) {
+		lineno++;
+		if ((nl = strchr(line, '\n')))
+			*nl = '\0';
+		if ((err = parse_line(line, t))) {
+			wlr_log(WLR_ERROR, "bindings: %s:%d: %s", path, lineno, err);
+			ret = -2;
+		}
+	}
+	free(line);
+	fclose(f);
+	return ret;
+}
+
+static void bindings_load_defaults(struct table *t) {
+	char line[256];
+	size_t i;
+
+	for (i = 0; i < LENGTH(default_bindings); i++) {
+		snprintf(line, sizeof(line), "%s", default_bindings[i]);
+		if (parse_line(line, t))
+			die("bindings: bad default binding: %s", default_bindings[i]);
+	}
+}
+
+int bindings_reload(void) {
+	struct table t = {0};
+	char *path = bindings_path();
+	int ret = path ? bindings_load_file(path, &t) : -1;
+
+	if (ret == -2) {
+		wlr_log(WLR_ERROR, "bindings: keeping the bindings in use");
+		table_free(&t);
+		free(path);
+		return -1;
+	}
+	if (ret == -1) {
+		if (path && errno != ENOENT)
+			wlr_log_errno(WLR_ERROR, "bindings: cannot read %s", path);
+		bindings_load_defaults(&t);
+		wlr_log(WLR_INFO, "bindings: %zu defaults", t.n);
+	} else {
+		wlr_log(WLR_INFO, "bindings: %zu from %s", t.n, path);
+	}
+	free(path);
+
+	table_free(&bindings);
+	bindings = t;
+	defaults = ret == -1;
+	return 0;
+}
+
+static int handlesighup(int signo, void *data) {
+	bindings_reload();
+	rules_reload();
+	return 0;
+}
+
+void bindings_init(void) {
+	bindings_reload();
+	sighup_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->display),
+			SIGHUP, handlesighup, NULL);
+}
+
+void bindings_finish(void) {
+	if (sighup_source)
+		wl_event_source_remove(sighup_source);
+	table_free(&bindings);
+}
+
+static const struct binding *find_held(uint32_t mods, uint32_t code) {
+	// Any binding whose modifiers are all held, largest set first and
+	// Mod before Shift between sets of the same size
+	const struct binding *b;
+	uint32_t held = mods & BIND_MODS, sub;
+	int n;
+
+	for (n = __builtin_popcount(held); n >= 0; n--) {
+		sub = held;
+		do {
+			if (__builtin_popcount(sub) == n &&
+					(b = table_find(&bindings, (mods & ~BIND_MODS) | sub, code)))
+				return b;
+			sub = (sub - 1) & held;
+		} while (sub != held);
+	}
+	return NULL;
+}
+
+static int bindings_run(uint32_t mods, uint32_t code) {
+	// Shift is only part of the binding when it changed nothing else:
+	// Mod+Shift+Left runs Mod+Left unless it has a binding of its own
+	const struct binding *b;
+
+	if (defaults)
+		b = find_held(mods, code);
+	else if (!(b = table_find(&bindings, mods, code)) && mods & WLR_MODIFIER_SHIFT)
+		b = table_find(&bindings, mods & ~WLR_MODIFIER_SHIFT, code);
+	if (!b)
+		return 0;
+	b->action->fn(&b->arg);
+	return 1;
+}
+
+int bindings_key(uint32_t mods, xkb_keysym_t sym) {
+	return bindings_run(mods & BIND_MODS, sym);
+}
+
+int bindings_button(uint32_t mods, uint32_t button) {
+	return bindings_run((mods & BIND_MODS) | BIND_BUTTON, button);
+}
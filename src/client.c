@@ -1,5 +1,3 @@
-#include <sys/wait.h>
-#include <errno.h>
 #include "wm.h"
 #include "client.h"
 
@@ -13,8 +11,10 @@ void client_focus(struct Client *c, int lift) {
 		return;
 
 	// Raise client in stacking order if requested
-	if (c && lift)
+	if (c && lift) {
 		wlr_scene_node_raise_to_top(&c->scene->node);
+		hittest_invalidate();
+	}
 
 	if (c && client_surface(c) == old)
 		return;
@@ -30,7 +30,7 @@ void client_focus(struct Client *c, int lift) {
 		wl_list_remove(&c->flink);
 		wl_list_insert(&server->focus_stack, &c->flink);
 		server->selmon = c->mon;
-		c->is_urgent = 0;
+		client_set_urgent(c, 0);
 		client_restack_surface(c);
 
 		// Don't change border color if there is an exclusive focus or we are
@@ -86,6 +86,17 @@ void client_resize(struct Client *c, struct wlr_box geo, int interact) {
 	c->geom = geo;
 	applybounds(c, bbox);
 
+	// this is a no-op if size hasn't changed
+	client_set_resize(c, client_set_size(c, c->geom.width - 2 * c->bw,
+			c->geom.height - 2 * c->bw));
+
+	// Tiled clients move together with the rest of their monitor's layout
+	// once everybody drew at the new size, see monitor_txn_defer()
+	if (interact || c->is_floating || !c->mon || !monitor_txn_defer(c->mon, c))
+		client_apply_geometry(c);
+}
+
+void client_apply_geometry(struct Client *c) {
 	// Update scene-graph, including borders
 	wlr_scene_node_set_position(&c->scene->node, c->geom.x, c->geom.y);
 	wlr_scene_node_set_position(&c->scene_surface->node, c->bw, c->bw);
@@ -96,10 +107,76 @@ void client_resize(struct Client *c, struct wlr_box geo, int interact) {
 	wlr_scene_node_set_position(&c->border[1]->node, 0, c->geom.height - c->bw);
 	wlr_scene_node_set_position(&c->border[2]->node, 0, c->bw);
 	wlr_scene_node_set_position(&c->border[3]->node, c->geom.width - c->bw, c->bw);
+	hittest_invalidate();
 
-	// this is a no-op if size hasn't changed
-	c->resize = client_set_size(c, c->geom.width - 2 * c->bw,
-			c->geom.height - 2 * c->bw);
+	if (c->saved) {
+		wlr_scene_node_destroy(&c->saved->node);
+		c->saved = NULL;
+		wlr_scene_node_set_enabled(&c->scene_surface->node, 1);
+	}
+	c->shown = 1;
+}
+
+static void client_save_buffer(struct wlr_scene_buffer *buffer, int sx, int sy, void *data) {
+	struct wlr_scene_tree *saved = data;
+	struct wlr_scene_buffer *copy;
+
+	if (!buffer->buffer)
+		return;
+	copy = wlr_scene_buffer_create(saved, buffer->buffer);
+	wlr_scene_buffer_set_dest_size(copy, buffer->dst_width, buffer->dst_height);
+	wlr_scene_buffer_set_source_box(copy, &buffer->src_box);
+	wlr_scene_buffer_set_transform(copy, buffer->transform);
+	wlr_scene_node_set_position(&copy->node, sx, sy);
+}
+
+void client_save_buffers(struct Client *c) {
+	// Keep showing what the client last drew while its live surface tree is
+	// hidden, the scene buffers hold a lock on the wlr_buffers
+	c->saved = wlr_scene_tree_create(c->scene);
+	// A client that was never placed has nothing worth showing yet
+	if (c->shown)
+		wlr_scene_node_for_each_buffer(&c->scene_surface->node, client_save_buffer, c->saved);
+	wlr_scene_node_set_enabled(&c->scene_surface->node, 0);
+}
+
+void client_set_resize(struct Client *c, uint32_t serial) {
+	// Monitor::pending_resizes follows c->resize here and c->mon in
+	// monitor_set(), is_floating only changes while the client has no monitor.
+	if (c->mon && !c->is_floating) {
+		if (serial && !c->resize)
+			c->mon->pending_resizes++;
+		else if (!serial && c->resize)
+			c->mon->pending_resizes--;
+	}
+	c->resize = serial;
+}
+
+void client_set_urgent(struct Client *c, int urgent) {
+	int i;
+
+	if (c->is_urgent == urgent)
+		return;
+	// Monitor::tag_urgent counts the client once for each of its tags
+	if (c->mon)
+		for (i = 0; i < TAGCOUNT; i++)
+			if (c->tags & 1u << i)
+				c->mon->tag_urgent[i] += urgent ? 1 : -1;
+	c->is_urgent = urgent;
+}
+
+void client_set_suspended(struct Client *c, int suspended) {
+	// A hidden client gets no frame callbacks, wlr_scene skips disabled
+	// trees; with xdg-shell v6 it also learns it should stop drawing
+	if (c->suspended == suspended)
+		return;
+	c->suspended = suspended;
+	// Nor would it draw a new size, the shown ones do not wait for it
+	if (suspended)
+		monitor_txn_drop(c);
+#if XDG_SHELL_VERSION >= 6
+	wlr_xdg_toplevel_set_suspended(c->surface->toplevel, suspended);
+#endif
 }
 
 void client_get_size_hints(struct Client *c, struct wlr_box *max, struct wlr_box *min) {
@@ -225,7 +302,9 @@ int client_is_rendered_on_mon(struct Client *c, struct Monitor *m) {
 	 * but rather actual displaying of the pixels.
 	 * Usually VISIBLEON suffices and is also faster. */
 	struct wlr_surface_output *s;
-	if (!c->scene->node.enabled)
+	int unused_lx, unused_ly;
+	// Hidden tags disable the parent tree, not the client node
+	if (!wlr_scene_node_coords(&c->scene->node, &unused_lx, &unused_ly))
 		return 0;
 	wl_list_for_each(s, &client_surface(c)->current_outputs, link)
 		if (s->output == m->wlr_output)
@@ -234,23 +313,8 @@ int client_is_rendered_on_mon(struct Client *c, struct Monitor *m) {
 }
 
 int client_is_stopped(struct Client *c) {
-	int pid;
-	siginfo_t in = {0};
-
-	wl_client_get_credentials(c->surface->client->client, &pid, NULL, NULL);
-	if (waitid(P_PID, pid, &in, WNOHANG|WCONTINUED|WSTOPPED|WNOWAIT) < 0) {
-		/* This process is not our child process, while is very unluckely that
-		 * it is stopped, in order to do not skip frames assume that it is. */
-		if (errno == ECHILD)
-			return 1;
-	} else if (in.si_pid) {
-		if (in.si_code == CLD_STOPPED || in.si_code == CLD_TRAPPED)
-			return 1;
-		if (in.si_code == CLD_CONTINUED)
-			return 0;
-	}
-
-	return 0;
+	// Kept up to date from the event loop, see procstate.c
+	return !c->proc || c->proc->stopped || c->proc->exited;
 }
 
 void client_notify_enter(struct wlr_surface *s, struct wlr_keyboard *kb) {
@@ -4,6 +4,16 @@ void client_focus(struct Client *c, int lift);
 
 void client_resize(struct Client *c, struct wlr_box geo, int interact);
 
+void client_set_resize(struct Client *c, uint32_t serial);
+
+void client_set_urgent(struct Client *c, int urgent);
+
+void client_set_suspended(struct Client *c, int suspended);
+
+void client_apply_geometry(struct Client *c);
+
+void client_save_buffers(struct Client *c);
+
 void client_get_size_hints(struct Client *c, struct wlr_box *max, struct wlr_box *min);
 
 struct wlr_surface *client_surface(struct Client *c);
@@ -4,7 +4,6 @@
 
 #include "wm.h"
 
-static const char broken[] = "broken";
 // Map from ZWLR_LAYER_SHELL_* constants to Lyr* enum
 static const int layermap[] = { LyrBg, LyrBottom, LyrTop, LyrOverlay };
 
@@ -14,8 +13,7 @@ void setfullscreen(struct Client *c, int fullscreen) {
 		return;
 	c->bw = fullscreen ? 0 : 2;
 	client_set_fullscreen(c, fullscreen);
-	wlr_scene_node_reparent(&c->scene->node, server->layers[fullscreen
-			? LyrFS : c->is_floating ? LyrFloat : LyrTile]);
+	client_reparent(c);
 
 	if (fullscreen) {
 		c->prev = c->geom;
@@ -56,17 +54,36 @@ void applybounds(struct Client *c, struct wlr_box *bbox) {
 
 void applyrules(struct Client *c) {
 	// rule matching
-	const char *appid, *title;
 	uint32_t newtags = 0;
 	struct Monitor *mon = server->selmon;
+	struct rule_match match;
+	struct process *p;
 
 	c->is_floating = client_is_float_type(c);
-	if (!(appid = client_get_appid(c)))
-		appid = broken;
-	if (!(title = client_get_title(c)))
-		title = broken;
+
+	// Started by a binding, shown where that was pressed; later windows of
+	// the same process go to selmon
+	if ((p = process_for_client(c)) && p->mon) {
+		mon = p->mon;
+		newtags = p->tags;
+		p->mon = NULL;
+	}
+
+	// Rules from the config win over where it was started
+	if (rules_match(c, &match)) {
+		if (match.set & RuleMonitor)
+			mon = match.mon;
+		if (match.set & RuleTags)
+			newtags = match.tags;
+		if (match.set & RuleFloating)
+			c->is_floating = match.floating;
+		if (match.set & RuleFullscreen)
+			c->is_fullscreen = match.fullscreen;
+		if (match.set & RuleGeometry && c->is_floating && mon)
+			rules_place(c, &match, mon);
+	}
 	
-	wlr_scene_node_reparent(&c->scene->node, server->layers[c->is_floating ? LyrFloat : LyrTile]);
+	client_reparent(c);
 	monitor_set(c, mon, newtags);
 }
 
@@ -74,12 +91,15 @@ void commitlayersurfacenotify(struct wl_listener *listener, void *data) {
 	struct LayerSurface *layersurface = wl_container_of(listener, layersurface, surface_commit);
 	struct wlr_layer_surface_v1 *wlr_layer_surface = layersurface->layer_surface;
 	struct wlr_output *wlr_output = wlr_layer_surface->output;
-	struct wlr_scene_tree *layer = server->layers[layermap[wlr_layer_surface->current.layer]];
+	struct wlr_scene_tree *layer;
 
 	// For some reason this layersurface have no monitor, this can be because
 	// its monitor has just been destroyed
 	if (!wlr_output || !(layersurface->mon = wlr_output->data))
 		return;
+	// Background and bottom surfaces are hidden along with their monitor's
+	// windows under a fullscreen client
+	layer = monitor_layer_tree(layersurface->mon, layermap[wlr_layer_surface->current.layer]);
 
 	if (layer != layersurface->scene->node.parent) {
 		wlr_scene_node_reparent(&layersurface->scene->node, layer);
@@ -87,6 +107,7 @@ void commitlayersurfacenotify(struct wl_listener *listener, void *data) {
 		wl_list_remove(&layersurface->link);
 		wl_list_insert(&layersurface->mon->layers[wlr_layer_surface->current.layer],
 				&layersurface->link);
+		hittest_invalidate();
 	}
 	if (wlr_layer_surface->current.layer < ZWLR_LAYER_SHELL_V1_LAYER_TOP)
 		wlr_scene_node_reparent(&layersurface->popups->node, server->layers[LyrTop]);
@@ -108,9 +129,18 @@ void commitnotify(struct wl_listener *listener, void *data) {
 			|| box.height != c->geom.height - 2 * c->bw))
 		c->is_floating ? client_resize(c, c->geom, 1) : monitor_arrange(c->mon);
 
+	latency_commit(c);
+
 	// mark a pending resize as completed
-	if (c->resize && c->resize <= c->surface->current.configure_serial)
-		c->resize = 0;
+	if (c->resize && c->resize <= c->surface->current.configure_serial) {
+		client_set_resize(c, 0);
+		if (!wl_list_empty(&c->txn_link))
+			monitor_txn_check(c->mon);
+	}
+
+	// The buffer may have become opaque (or stopped being)
+	if (c->is_fullscreen && c->mon)
+		monitor_update_fullscreen(c->mon);
 }
 
 void createdecoration(struct wl_listener *listener, void *data) {
@@ -165,6 +195,23 @@ void createlayersurface(struct wl_listener *listener, void *data) {
 	wlr_layer_surface->current = old_state;
 }
 
+struct Popup {
+	struct wl_listener map;
+	struct wl_listener destroy;
+};
+
+static void popupmap(struct wl_listener *listener, void *data) {
+	// Whatever the pointer was over may be under the popup now
+	hittest_invalidate();
+}
+
+static void popupdestroy(struct wl_listener *listener, void *data) {
+	struct Popup *p = wl_container_of(listener, p, destroy);
+	wl_list_remove(&p->map.link);
+	wl_list_remove(&p->destroy.link);
+	free(p);
+}
+
 void createnotify(struct wl_listener *listener, void *data) {
 	// This event is raised when wlr_xdg_shell receives a new xdg surface from a
 	// client, either a toplevel (application window) or popup,
@@ -174,14 +221,19 @@ void createnotify(struct wl_listener *listener, void *data) {
 	struct wlr_xdg_surface *xdg_surface = data;
 	struct Client *c = NULL;
 	struct LayerSurface *l = NULL;
+	pid_t pid;
 
 	if (xdg_surface->role == WLR_XDG_SURFACE_ROLE_POPUP) {
 		struct wlr_box box;
+		struct Popup *p;
 		int type = toplevel_from_wlr_surface(xdg_surface->surface, &c, &l);
 		if (!xdg_surface->popup->parent || type < 0)
 			return;
 		xdg_surface->surface->data = wlr_scene_xdg_surface_create(
 				xdg_surface->popup->parent->data, xdg_surface);
+		p = ecalloc(1, sizeof(*p));
+		LISTEN(&xdg_surface->events.map, &p->map, popupmap);
+		LISTEN(&xdg_surface->events.destroy, &p->destroy, popupdestroy);
 		if ((l && !l->mon) || (c && !c->mon))
 			return;
 		box = type == LayerShell ? l->mon->m : c->mon->w;
@@ -196,6 +248,11 @@ void createnotify(struct wl_listener *listener, void *data) {
 	c = xdg_surface->data = ecalloc(1, sizeof(*c));
 	c->surface = xdg_surface;
 	c->bw = 2;
+	wl_list_init(&c->txn_link);
+	wl_client_get_credentials(xdg_surface->client->client, &pid, NULL, NULL);
+	c->proc = procstate_get(pid);
+	// Still before the initial configure
+	rules_configure(c);
 
 	LISTEN(&xdg_surface->events.map, &c->map, mapnotify);
 	LISTEN(&xdg_surface->events.unmap, &c->unmap, unmapnotify);
@@ -267,6 +324,7 @@ mapnotify(struct wl_listener *listener, void *data)
 		LISTEN(&client_surface(c)->events.commit, &c->commit, commitnotify);
 	}
 	c->scene->node.data = c->scene_surface->node.data = c;
+	c->shown = 0;
 
 	for (i = 0; i < 4; i++) {
 		c->border[i] = wlr_scene_rect_create(c->scene, 0, 0, (float[]){0.5f, 0.5f, 0.5f, 1.0f});
@@ -280,6 +338,7 @@ mapnotify(struct wl_listener *listener, void *data)
 	c->geom.height += 2 * c->bw;
 
 	/* Insert this client into client lists. */
+	c->seq = ++server->client_seq;
 	wl_list_insert(&server->clients, &c->link);
 	wl_list_insert(&server->focus_stack, &c->flink);
 
@@ -290,9 +349,9 @@ mapnotify(struct wl_listener *listener, void *data)
 	 /* TODO: https://github.com/djpohly/dwl/pull/334#issuecomment-1330166324 */
 	if (c->type == XDGShell && (p = client_get_parent(c))) {
 		c->is_floating = 1;
-		wlr_scene_node_reparent(&c->scene->node, server->layers[LyrFloat]);
+		client_reparent(c);
 		monitor_set(c, p->mon, p->tags);
-	} else {
+	} else if (!pool_adopt(c)) {
 		applyrules(c);
 	}
 	printstatus();
@@ -321,7 +380,7 @@ motionabsolute(struct wl_listener *listener, void *data)
 	 * emits these events. */
 	struct wlr_pointer_motion_absolute_event *event = data;
 	wlr_cursor_warp_absolute(server->cursor, &event->pointer->base, event->x, event->y);
-	motionnotify(event->time_msec);
+	motion_queue(event->time_msec);
 }
 
 void
@@ -394,47 +453,6 @@ outputmgrtest(struct wl_listener *listener, void *data)
 	outputmgrapplyortest(config, 1);
 }
 
-void
-printstatus(void)
-{
-	struct Monitor *m = NULL;
-	struct Client *c;
-	uint32_t occ, urg, sel;
-	const char *appid, *title;
-
-	wl_list_for_each(m, &server->monitors, link) {
-		occ = urg = 0;
-		wl_list_for_each(c, &server->clients, link) {
-			if (c->mon != m)
-				continue;
-			occ |= c->tags;
-			if (c->is_urgent)
-				urg |= c->tags;
-		}
-		if ((c = monitor_get_top_client(m))) {
-			title = client_get_title(c);
-			appid = client_get_appid(c);
-			printf("%s title %s\n", m->wlr_output->name, title ? title : broken);
-			printf("%s appid %s\n", m->wlr_output->name, appid ? appid : broken);
-			printf("%s fullscreen %u\n", m->wlr_output->name, c->is_fullscreen);
-			printf("%s floating %u\n", m->wlr_output->name, c->is_floating);
-			sel = c->tags;
-		} else {
-			printf("%s title \n", m->wlr_output->name);
-			printf("%s appid \n", m->wlr_output->name);
-			printf("%s fullscreen \n", m->wlr_output->name);
-			printf("%s floating \n", m->wlr_output->name);
-			sel = 0;
-		}
-
-		printf("%s selmon %u\n", m->wlr_output->name, m == server->selmon);
-		printf("%s tags %u %u %u %u\n", m->wlr_output->name, occ, m->tagset[m->seltags],
-				sel, urg);
-		printf("%s layout []=\n", m->wlr_output->name);
-	}
-	fflush(stdout);
-}
-
 void
 setcursor(struct wl_listener *listener, void *data)
 {
@@ -518,7 +536,13 @@ unmapnotify(struct wl_listener *listener, void *data)
 		server->cursor_mode = CurNormal;
 		server->grabc = NULL;
 	}
+	if (c == server->pointerc)
+		server->pointerc = NULL;
 
+	latency_forget(client_surface(c));
+	hittest_invalidate();
+	if (c->pooled)
+		pool_forget(c);
 	wl_list_remove(&c->link);
 	monitor_set(c, NULL, 0);
 	wl_list_remove(&c->flink);
@@ -603,7 +627,7 @@ updatemons(struct wl_listener *listener, void *data)
 
 	if (server->selmon && server->selmon->wlr_output->enabled) {
 		wl_list_for_each(c, &server->clients, link)
-			if (!c->mon && client_is_mapped(c)) {
+			if (!c->mon && !c->pooled && client_is_mapped(c)) {
 				monitor_set(c, server->selmon, c->tags);
 			}
 		client_focus(monitor_get_top_client(server->selmon), 1);
@@ -630,41 +654,205 @@ urgent(struct wl_listener *listener, void *data)
 {
 	struct wlr_xdg_activation_v1_request_activate_event *event = data;
 	struct Client *c = NULL;
+	struct process *p;
 	toplevel_from_wlr_surface(event->surface, &c, NULL);
+	// A window its pid did not lead to, activated with the token of a
+	// process the user started before it was ever drawn: not a move yet
+	if (c && c->mon && !c->shown && (p = process_for_token(event->token)) && p->mon) {
+		monitor_set(c, p->mon, p->tags);
+		p->mon = NULL;
+	}
 	if (c && c != monitor_get_top_client(server->selmon)) {
-		c->is_urgent = 1;
+		client_set_urgent(c, 1);
 		printstatus();
 	}
 }
 
+/*
+ * Hit-test cache: the tree of the client or layer surface the pointer was
+ * last found over, kept only while nothing else in its layer or above it
+ * overlaps its box. As long as the pointer stays inside that box, hit
+ * testing the one tree gives the same answer as walking the whole scene.
+ * Anything that may put something new on top of it calls
+ * hittest_invalidate().
+ */
+static struct {
+	struct wlr_scene_node *root;
+	struct wlr_box box; // layout box of everything under root
+	int x, y; // layout position of root when the box was taken
+	struct Client *c;
+	struct LayerSurface *l;
+} hit;
+
+void
+hittest_invalidate(void)
+{
+	hit.root = NULL;
+}
+
+static void
+node_box(struct wlr_scene_node *node, int lx, int ly, struct wlr_box *box)
+{
+	// Box of a rect or buffer node whose parent sits at lx, ly
+	struct wlr_scene_rect *rect;
+	struct wlr_scene_buffer *buffer;
+
+	*box = (struct wlr_box){lx + node->x, ly + node->y, 0, 0};
+	if (node->type == WLR_SCENE_NODE_RECT) {
+		rect = wl_container_of(node, rect, node);
+		box->width = rect->width;
+		box->height = rect->height;
+	} else if (node->type == WLR_SCENE_NODE_BUFFER) {
+		buffer = wlr_scene_buffer_from_node(node);
+		if (buffer->dst_width > 0) {
+			box->width = buffer->dst_width;
+			box->height = buffer->dst_height;
+		} else if (buffer->buffer) {
+			// Either way round, the transform may swap them
+			box->width = box->height = MAX(buffer->buffer->width, buffer->buffer->height);
+		}
+	}
+}
+
+static void
+node_extents(struct wlr_scene_node *node, int lx, int ly, struct wlr_box *ext)
+{
+	struct wlr_scene_tree *tree;
+	struct wlr_scene_node *child;
+	struct wlr_box box;
+	int x2, y2;
+
+	if (!node->enabled)
+		return;
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		tree = wl_container_of(node, tree, node);
+		wl_list_for_each(child, &tree->children, link)
+			node_extents(child, lx + node->x, ly + node->y, ext);
+		return;
+	}
+	node_box(node, lx, ly, &box);
+	if (wlr_box_empty(&box))
+		return;
+	if (wlr_box_empty(ext)) {
+		*ext = box;
+		return;
+	}
+	x2 = MAX(ext->x + ext->width, box.x + box.width);
+	y2 = MAX(ext->y + ext->height, box.y + box.height);
+	ext->x = MIN(ext->x, box.x);
+	ext->y = MIN(ext->y, box.y);
+	ext->width = x2 - ext->x;
+	ext->height = y2 - ext->y;
+}
+
+static int
+node_overlaps(struct wlr_scene_node *node, int lx, int ly,
+		struct wlr_scene_node *skip, const struct wlr_box *box)
+{
+	// Whether anything shown under node, skip aside, intersects box
+	struct wlr_scene_tree *tree;
+	struct wlr_scene_node *child;
+	struct wlr_box nbox, unused;
+
+	if (!node->enabled || node == skip)
+		return 0;
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		tree = wl_container_of(node, tree, node);
+		wl_list_for_each(child, &tree->children, link)
+			if (node_overlaps(child, lx + node->x, ly + node->y, skip, box))
+				return 1;
+		return 0;
+	}
+	node_box(node, lx, ly, &nbox);
+	return wlr_box_intersection(&unused, &nbox, box);
+}
+
+static void
+hittest_fill(struct wlr_scene_node *root, int layer, struct Client *c, struct LayerSurface *l)
+{
+	int px, py, i;
+
+	hit.root = NULL;
+	if (!wlr_scene_node_coords(&root->parent->node, &px, &py))
+		return;
+	hit.box = (struct wlr_box){0};
+	node_extents(root, px, py, &hit.box);
+	if (wlr_box_empty(&hit.box))
+		return;
+	// Layer trees sit at the origin of the scene
+	for (i = layer; i < NUM_LAYERS; i++)
+		if (node_overlaps(&server->layers[i]->node, 0, 0, root, &hit.box))
+			return;
+	hit.root = root;
+	hit.x = px + root->x;
+	hit.y = py + root->y;
+	hit.c = c;
+	hit.l = l;
+}
+
+static struct wlr_surface *
+node_surface(struct wlr_scene_node *node)
+{
+	// Buffers saved during a resize have no surface behind them
+	struct wlr_scene_surface *scene_surface;
+
+	if (node->type == WLR_SCENE_NODE_BUFFER && (scene_surface =
+			wlr_scene_surface_from_buffer(wlr_scene_buffer_from_node(node))))
+		return scene_surface->surface;
+	return NULL;
+}
+
 struct wlr_scene_node *
 xytonode(double x, double y, struct wlr_surface **psurface,
 		struct Client **pc, struct LayerSurface **pl, double *nx, double *ny)
 {
-	struct wlr_scene_node *node, *pnode;
+	struct wlr_scene_node *node, *pnode = NULL;
 	struct wlr_surface *surface = NULL;
 	struct Client *c = NULL;
 	struct LayerSurface *l = NULL;
-	int layer;
+	int layer, rx, ry, border = 0;
+	uint64_t start = prof_begin();
+
+	// Borders are rects inside the cached tree, they hit with no surface
+	if (hit.root && !server->locked && wlr_box_contains_point(&hit.box, x, y)
+			&& wlr_scene_node_coords(hit.root, &rx, &ry)
+			&& rx == hit.x && ry == hit.y
+			&& (node = wlr_scene_node_at(hit.root, x, y, nx, ny))
+			&& ((surface = node_surface(node)) || node->type == WLR_SCENE_NODE_RECT)) {
+		c = hit.c;
+		l = hit.l;
+		goto out;
+	}
 
-	for (layer = NUM_LAYERS - 1; !surface && layer >= 0; layer--) {
+	for (layer = NUM_LAYERS - 1; layer >= 0; layer--) {
 		if (!(node = wlr_scene_node_at(&server->layers[layer]->node, x, y, nx, ny)))
 			continue;
 
-		if (node->type == WLR_SCENE_NODE_BUFFER)
-			surface = wlr_scene_surface_from_buffer(
-					wlr_scene_buffer_from_node(node))->surface;
+		surface = node_surface(node);
 		/* Walk the tree to find a node that knows the client */
-		for (pnode = node; pnode && !c; pnode = &pnode->parent->node)
-			c = pnode->data;
-		if (c && c->type == LayerShell) {
+		for (pnode = node; pnode && !pnode->data; pnode = &pnode->parent->node)
+			;
+		if (!c && !l && pnode && (c = pnode->data) && c->type == LayerShell) {
 			c = NULL;
 			l = pnode->data;
 		}
+		// A client's border ends the walk like its surface does
+		border = c && node->type == WLR_SCENE_NODE_RECT && node->data == c;
+		if (surface || border)
+			break;
 	}
 
+	// Only a surface or border that belongs to the client found along with
+	// it, popups of layer surfaces and lock surfaces are not worth it
+	if ((surface || border) && pnode && !server->locked && (c
+			? border || pnode == &c->scene->node || pnode == &c->scene_surface->node
+			: l && pnode == &l->scene->node))
+		hittest_fill(c ? &c->scene->node : &l->scene->node, layer, c, l);
+
+out:
 	if (psurface) *psurface = surface;
 	if (pc) *pc = c;
 	if (pl) *pl = l;
+	prof_end(ProfXytonode, start);
 	return node;
 }
@@ -41,6 +41,7 @@ void destroylayersurfacenotify(struct wl_listener *listener, void *data) {
 	wl_list_remove(&layersurface->unmap.link);
 	wl_list_remove(&layersurface->surface_commit.link);
 	wlr_scene_node_destroy(&layersurface->scene->node);
+	hittest_invalidate();
 	free(layersurface);
 }
 
@@ -91,6 +92,7 @@ void destroynotify(struct wl_listener *listener, void *data) {
 	wl_list_remove(&c->destroy.link);
 	wl_list_remove(&c->set_title.link);
 	wl_list_remove(&c->fullscreen.link);
+	procstate_put(c->proc);
 	free(c);
 }
 
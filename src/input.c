@@ -1,13 +1,13 @@
 #include "wm.h"
 
-static void togglefullscreen(void) {
+void togglefullscreen(void) {
 	struct Client *sel = monitor_get_top_client(server->selmon);
 	if (sel) {
 		setfullscreen(sel, !sel->is_fullscreen);
 	}
 }
 
-static void incnmaster(int i) {
+void incnmaster(int i) {
 	if (!server->selmon) return;
 
 	// this needs to be improved
@@ -17,14 +17,14 @@ static void incnmaster(int i) {
 	monitor_arrange(server->selmon);
 }
 
-static void monitor_tag(enum wlr_direction dir) {
+void monitor_tag(int dir) {
 	struct Client *sel = monitor_get_top_client(server->selmon);
 	if (sel) {
 		monitor_set(sel, monitor_get_by_direction(dir), 0);
 	}
 }
 
-static void monitor_focus(int dir) {
+void monitor_focus(int dir) {
 	int i = 0;
 	int nmons = wl_list_length(&server->monitors);
 	if (nmons) {
@@ -36,10 +36,10 @@ static void monitor_focus(int dir) {
 	client_focus(monitor_get_top_client(server->selmon), 1);
 }
 
-static void tag(uint32_t ui) {
+void tag(uint32_t ui) {
 	struct Client *sel = monitor_get_top_client(server->selmon);
 	if (sel && ui & TAGMASK) {
-		sel->tags = ui & TAGMASK;
+		monitor_retag_client(sel, ui & TAGMASK);
 		client_focus(monitor_get_top_client(server->selmon), 1);
 		monitor_arrange(server->selmon);
 	}
@@ -47,13 +47,13 @@ static void tag(uint32_t ui) {
 	printstatus();
 }
 
-static void kill_focused_client(void) {
+void kill_focused_client(void) {
 	struct Client *sel = monitor_get_top_client(server->selmon);
 	if (sel)
 		client_send_close(sel);
 }
 
-static void view(uint32_t ui) {
+void view(uint32_t ui) {
 	if (!server->selmon || (ui & TAGMASK) == server->selmon->tagset[server->selmon->seltags]) {
 		return;
 	}
@@ -68,43 +68,32 @@ static void view(uint32_t ui) {
 	printstatus();
 }
 
-static void focus_prev(void) {
-	struct Client *c, *sel = monitor_get_top_client(server->selmon);
+void focus_prev(void) {
+	struct Client **visible, *sel = monitor_get_top_client(server->selmon);
+	size_t i, n;
 	if (!sel || sel->is_fullscreen) {
 		return;
 	}
 
-	wl_list_for_each_reverse(c, &sel->link, link) {
-		if (&c->link == &server->clients) {
-			continue; // wrap past the sentinel node
-		}
-
-		if (VISIBLEON(c, server->selmon)) {
-			break; // found it
-		}
-	}
+	// sel is visible, so it is always found
+	visible = monitor_visible_clients(server->selmon, &n);
+	for (i = 0; visible[i] != sel; i++);
 
-	// if only one client is visible on server->selmon, then c == sel
-	client_focus(c, 1);
+	// if only one client is visible on server->selmon, then this is sel
+	client_focus(visible[(i + n - 1) % n], 1);
 }
 
-static void focus_next(void) {
-	struct Client *c, *sel = monitor_get_top_client(server->selmon);
+void focus_next(void) {
+	struct Client **visible, *sel = monitor_get_top_client(server->selmon);
+	size_t i, n;
 	if (!sel || sel->is_fullscreen)
 		return;
 
-	wl_list_for_each(c, &sel->link, link) {
-		if (&c->link == &server->clients) {
-			continue; // wrap past the sentinel node
-		}
+	visible = monitor_visible_clients(server->selmon, &n);
+	for (i = 0; visible[i] != sel; i++);
 
-		if (VISIBLEON(c, server->selmon)) {
-			break; // found it - dwl source code author
-		}
-	}
-
-	// if only one client is visible on server->selmon, then c == sel
-	client_focus(c, 1);
+	// if only one client is visible on server->selmon, then this is sel
+	client_focus(visible[(i + 1) % n], 1);
 }
 
 void axisnotify(struct wl_listener *listener, void *data) {
@@ -112,6 +101,7 @@ void axisnotify(struct wl_listener *listener, void *data) {
 	 * for example when you move the scroll wheel. */
 	struct wlr_pointer_axis_event *event = data;
 	IDLE_NOTIFY_ACTIVITY;
+	motion_flush();
 	/* TODO: allow usage of scroll whell for mousebindings, it can be implemented
 	 * checking the event's orientation and the delta of the event */
 	/* Notify the client with pointer focus of the axis event. */
@@ -120,67 +110,94 @@ void axisnotify(struct wl_listener *listener, void *data) {
 			event->delta_discrete, event->source);
 }
 
-static void spawn_wpctl(const char *percentage) {
-	if (fork() == 0) {
-		dup2(STDERR_FILENO, STDOUT_FILENO);
-		setsid();
-		execl("/usr/bin/wpctl", "/usr/bin/wpctl", "set-volume", "@DEFAULT_AUDIO_SINK@", percentage, NULL);
-		die("dwl: execl /usr/bin/playerctl failed:");
-	}
-}
-
-static void spawn_playerctl(const char *operation) {
-	if (fork() == 0) {
-		dup2(STDERR_FILENO, STDOUT_FILENO);
-		setsid();
-		execl("/usr/bin/playerctl", "/usr/bin/playerctl", operation, NULL);
-		die("dwl: execl /usr/bin/playerctl failed:");
-	}
-}
-
-static void handle_mouse_button(uint32_t mods, unsigned int button) {
-	if (mods & MODKEY && button == BTN_SIDE) {
-		spawn_playerctl("play-pause");
-		return;
-	}
-
-	if (button == BTN_EXTRA && mods & WLR_MODIFIER_SHIFT) {
-		spawn_wpctl("2%+");
-		return;
-	} else if (button == BTN_SIDE && mods & WLR_MODIFIER_SHIFT) {
-		spawn_wpctl("2%-");
-		return;
-	}
-
-	if (button == BTN_EXTRA) {
-		spawn_playerctl("next");
-		return;
-	} else if (button == BTN_SIDE) {
-		spawn_playerctl("previous");
-		return;
-	}
+static int client_has_focus(struct Client *c) {
+	return client_surface(c) == server->seat->keyboard_state.focused_surface;
 }
 
 void buttonpress(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_button_event *event = data;
 	struct wlr_keyboard *keyboard;
+	struct Client *c = NULL;
+	double sx, sy;
 	uint32_t mods;
 
 	IDLE_NOTIFY_ACTIVITY;
+	// The button goes to whatever is under the cursor now
+	motion_flush();
 
 	if (event->state == WLR_BUTTON_PRESSED && !server->locked) {
+		if (FOCUS_POLICY == FocusClick) {
+			xytonode(server->cursor->x, server->cursor->y, NULL, &c, NULL, &sx, &sy);
+			if (c && !client_has_focus(c))
+				client_focus(c, 1);
+		}
 		keyboard = wlr_seat_get_keyboard(server->seat);
 		mods = keyboard ? wlr_keyboard_get_modifiers(keyboard) : 0;
-		handle_mouse_button(mods, event->button);
+		bindings_button(mods, event->button);
 	}
 
 	// If the event wasn't handled by the compositor, notify the client with
 	// pointer focus that a button press has occurred
 	wlr_seat_pointer_notify_button(server->seat, event->time_msec, event->button, event->state);
+	latency_input(event->time_msec, server->seat->pointer_state.focused_surface);
+}
+
+/*
+ * Coalesced pointer motion. Mice polling at 1kHz and more deliver several
+ * motion events per event loop iteration, only the last position matters
+ * for the hit test, focus and the wl_pointer.motion clients get. The frame
+ * that closes the motion is held back until the motion went out.
+ */
+static struct {
+	struct wl_event_source *idle;
+	int pending;
+	int frame; // a frame is owed after the motion
+	uint32_t first; // time of the oldest motion, for the latency tracer
+	uint32_t time; // time of the newest motion
+} motion;
+
+void motion_flush(void) {
+	if (!motion.pending)
+		return;
+	if (motion.idle)
+		wl_event_source_remove(motion.idle);
+	motion.idle = NULL;
+	motion.pending = 0;
+
+	motionnotify(motion.time);
+	latency_input(motion.first, server->seat->pointer_state.focused_surface);
+	if (motion.frame) {
+		motion.frame = 0;
+		wlr_seat_pointer_notify_frame(server->seat);
+	}
+}
+
+static void motion_idle(void *data) {
+	// The event loop drops the source itself once we return
+	motion.idle = NULL;
+	motion_flush();
+}
+
+void motion_queue(uint32_t time) {
+	if (!MOTION_COALESCE) {
+		motionnotify(time);
+		latency_input(time, server->seat->pointer_state.focused_surface);
+		return;
+	}
+	if (!motion.pending)
+		motion.first = time;
+	motion.pending = 1;
+	motion.time = time;
+	if (!motion.idle)
+		motion.idle = wl_event_loop_add_idle(
+				wl_display_get_event_loop(server->display), motion_idle, NULL);
 }
 
 void cursorframe(struct wl_listener *listener, void *data) {
-	wlr_seat_pointer_notify_frame(server->seat);
+	if (motion.pending)
+		motion.frame = 1;
+	else
+		wlr_seat_pointer_notify_frame(server->seat);
 }
 
 void motionnotify(uint32_t time) {
@@ -192,8 +209,11 @@ void motionnotify(uint32_t time) {
 	if (time) {
 		IDLE_NOTIFY_ACTIVITY;
 
-		// Update selmon (even while dragging a window)
-		server->selmon = xytomon(server->output_layout, server->cursor->x, server->cursor->y);
+		// Update selmon (even while dragging a window), the layout only has
+		// to be asked once the cursor leaves it
+		if (!server->selmon || !wlr_box_contains_point(&server->selmon->m,
+				server->cursor->x, server->cursor->y))
+			server->selmon = xytomon(server->output_layout, server->cursor->x, server->cursor->y);
 	}
 
 	// Find the client under the pointer and send the event along.
@@ -211,157 +231,12 @@ void motionnotify(uint32_t time) {
 
 void motionrelative(struct wl_listener *listener, void *data) {
 	struct wlr_pointer_motion_event *event = data;
+	// Clients using relative motion get every delta, nothing coalesced
+	wlr_relative_pointer_manager_v1_send_relative_motion(server->relative_pointer_mgr,
+			server->seat, (uint64_t)event->time_msec * 1000,
+			event->delta_x, event->delta_y, event->unaccel_dx, event->unaccel_dy);
 	wlr_cursor_move(server->cursor, &event->pointer->base, event->delta_x, event->delta_y);
-	motionnotify(event->time_msec);
-}
-
-static void spawn_terminal(void) {
-	if (fork() == 0) {
-		dup2(STDERR_FILENO, STDOUT_FILENO);
-		setsid();
-		execl("/usr/bin/footclient", "/usr/bin/footclient", NULL);
-		die("dwl: execl /usr/bin/footclient failed:");
-	}
-}
-
-static void spawn_bemenu(void) {
-	if (fork() == 0) {
-		dup2(STDERR_FILENO, STDOUT_FILENO);
-		setsid();
-		execl("/usr/bin/bemenu-run", "/usr/bin/bemenu-run", NULL);
-		die("bemenu-run: execl /usr/bin/bemenu-run failed:");
-	}
-}
-
-
-static int key_bindings(uint32_t mods, xkb_keysym_t sym) {
-	if (!(mods & MODKEY)) return 0;
-
-	if (sym >= XKB_KEY_1 && sym <= XKB_KEY_9) {
-		view(1 << (sym - XKB_KEY_1));
-		return 1;
-	}
-	
-	switch (sym) {
-		case XKB_KEY_d:
-			spawn_bemenu();
-			return 1;
-
-		case XKB_KEY_Return:
-			spawn_terminal();
-			return 1;
-
-		case XKB_KEY_Left:
-		case XKB_KEY_j:
-			focus_next();
-			return 1;
-
-		case XKB_KEY_Right:
-		case XKB_KEY_k:
-			focus_prev();
-			return 1;
-
-		case XKB_KEY_Up:
-		case XKB_KEY_i:
-			incnmaster(+1);
-			return 1;
-
-		case XKB_KEY_Down:
-		case XKB_KEY_u:
-			incnmaster(-1);
-			return 1;
-
-		case XKB_KEY_Tab:
-			view(0);
-			return 1;
-
-		case XKB_KEY_f:
-			togglefullscreen();
-			return 1;
-
-		case XKB_KEY_comma:
-			monitor_focus(WLR_DIRECTION_LEFT);
-			return 1;
-
-		case XKB_KEY_period:
-			monitor_focus(WLR_DIRECTION_RIGHT);
-			return 1;
-
-		default:
-			break;
-	}
-
-	if (!(mods & WLR_MODIFIER_SHIFT)) return 0;
-
-	switch (sym) {
-		case XKB_KEY_exclam:
-			tag(1 << 0);
-			view(1 << 0);
-			return 1;
-
-		case XKB_KEY_at:	
-			tag(1 << 1);
-			view(1 << 1);
-			return 1;
-
-		case XKB_KEY_numbersign:
-			tag(1 << 2);
-			view(1 << 2);
-			return 1;
-
-		case XKB_KEY_dollar:	
-			tag(1 << 3);
-			view(1 << 3);
-			return 1;
-
-		case XKB_KEY_percent:	
-			tag(1 << 4);
-			view(1 << 4);
-			return 1;
-
-		case XKB_KEY_asciicircum:	
-			tag(1 << 5);
-			view(1 << 5);
-			return 1;
-
-		case XKB_KEY_ampersand:	
-			tag(1 << 6);
-			view(1 << 6);
-			return 1;
-
-		case XKB_KEY_asterisk:
-			tag(1 << 7);
-			view(1 << 7);
-			return 1;
-
-		case XKB_KEY_parenleft:
-			tag(1 << 8);
-			view(1 << 8);
-			return 1;
-
-		case XKB_KEY_E:
-			wl_display_terminate(server->display);
-			return 1;
-
-		case XKB_KEY_Q:
-			kill_focused_client();
-			return 1;
-
-		case XKB_KEY_less:
-			monitor_tag(WLR_DIRECTION_LEFT);
-			monitor_focus(WLR_DIRECTION_LEFT);
-			return 1;
-
-		case XKB_KEY_greater:
-			monitor_tag(WLR_DIRECTION_RIGHT);
-			monitor_focus(WLR_DIRECTION_RIGHT);
-			return 1;
-
-		default:
-			break;
-	}
-
-	return 0;
+	motion_queue(event->time_msec);
 }
 
 void keypress(struct wl_listener *listener, void *data) {
@@ -380,13 +255,15 @@ void keypress(struct wl_listener *listener, void *data) {
 	uint32_t mods = wlr_keyboard_get_modifiers(kb->wlr_keyboard);
 
 	IDLE_NOTIFY_ACTIVITY;
+	// Keys read along with pointer motion go where the pointer focused
+	motion_flush();
 
 	// On _press_ if there is no active screen locker,
 	// attempt to process a compositor keybinding.
 	if (!server->locked && !server->input_inhibit_mgr->active_inhibitor
 			&& event->state == WL_KEYBOARD_KEY_STATE_PRESSED)
 		for (i = 0; i < nsyms; i++) {
-			handled = key_bindings(mods, syms[i]) || handled;
+			handled = bindings_key(mods, syms[i]) || handled;
 			if (handled) break;
 		}
 
@@ -404,6 +281,7 @@ void keypress(struct wl_listener *listener, void *data) {
 		// Pass unhandled keycodes along to the client. 
 		wlr_seat_set_keyboard(server->seat, kb->wlr_keyboard);
 		wlr_seat_keyboard_notify_key(server->seat, event->time_msec, event->keycode, event->state);
+		latency_input(event->time_msec, server->seat->keyboard_state.focused_surface);
 	}
 }
 
@@ -429,7 +307,7 @@ int keyrepeat(void *data) {
 		wl_event_source_timer_update(kb->key_repeat_source, 1000 / kb->wlr_keyboard->repeat_info.rate);
 
 		for (i = 0; i < kb->nsyms; i++) {
-			key_bindings(kb->mods, kb->keysyms[i]);
+			bindings_key(kb->mods, kb->keysyms[i]);
 		}
 	}
 
@@ -447,19 +325,94 @@ void cleanupkeyboard(struct wl_listener *listener, void *data) {
 	free(kb);
 }
 
+/*
+ * Compiled keymaps by RMLVO names, all from one xkb context. Compiling a
+ * keymap takes tens of milliseconds, keyboards that ask for names already
+ * compiled (hotplug, virtual keyboards coming and going) share the keymap.
+ */
+struct keymap {
+	char *names[5]; // rules, model, layout, variant, options, NULL if unset
+	struct xkb_keymap *keymap;
+	struct wl_list link;
+};
+
+static struct xkb_context *xkb_context;
+static struct wl_list keymaps;
+
+static const char *keymap_name(const char *name, const char *env) {
+	// libxkbcommon falls back to the environment the same way
+	if (!name || !*name)
+		name = getenv(env);
+	return name && *name ? name : NULL;
+}
+
+static struct xkb_keymap *keymap_get(const struct xkb_rule_names *rmlvo) {
+	static const struct xkb_rule_names none = {0};
+	const char *names[5];
+	struct keymap *k;
+	size_t i;
+
+	if (!rmlvo)
+		rmlvo = &none;
+	names[0] = keymap_name(rmlvo->rules, "XKB_DEFAULT_RULES");
+	names[1] = keymap_name(rmlvo->model, "XKB_DEFAULT_MODEL");
+	names[2] = keymap_name(rmlvo->layout, "XKB_DEFAULT_LAYOUT");
+	names[3] = keymap_name(rmlvo->variant, "XKB_DEFAULT_VARIANT");
+	names[4] = keymap_name(rmlvo->options, "XKB_DEFAULT_OPTIONS");
+
+	wl_list_for_each(k, &keymaps, link) {
+		for (i = 0; i < LENGTH(names); i++)
+			if (names[i] != k->names[i] && (!names[i] || !k->names[i]
+					|| strcmp(names[i], k->names[i])))
+				break;
+		if (i == LENGTH(names))
+			return k->keymap;
+	}
+
+	k = ecalloc(1, sizeof(*k));
+	if (!(k->keymap = xkb_keymap_new_from_names(xkb_context, &(struct xkb_rule_names){
+			names[0], names[1], names[2], names[3], names[4]}, XKB_KEYMAP_COMPILE_NO_FLAGS))) {
+		free(k);
+		return NULL;
+	}
+	for (i = 0; i < LENGTH(names); i++)
+		if (names[i] && !(k->names[i] = strdup(names[i])))
+			die("strdup:");
+	wl_list_insert(&keymaps, &k->link);
+	return k->keymap;
+}
+
+void keymap_init(void) {
+	if (!(xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS)))
+		die("xkb_context_new failed");
+	wl_list_init(&keymaps);
+	if (KEYMAP_PRECOMPILE && !keymap_get(NULL))
+		wlr_log(WLR_ERROR, "cannot compile the default keymap");
+}
+
+void keymap_finish(void) {
+	struct keymap *k, *tmp;
+	size_t i;
+
+	wl_list_for_each_safe(k, tmp, &keymaps, link) {
+		xkb_keymap_unref(k->keymap);
+		for (i = 0; i < LENGTH(k->names); i++)
+			free(k->names[i]);
+		wl_list_remove(&k->link);
+		free(k);
+	}
+	xkb_context_unref(xkb_context);
+}
+
 void createkeyboard(struct wlr_keyboard *keyboard) {
-	struct xkb_context *context;
 	struct xkb_keymap *keymap;
 	struct Keyboard *kb = keyboard->data = ecalloc(1, sizeof(*kb));
 	kb->wlr_keyboard = keyboard;
 
-	// Prepare an XKB keymap and assign it to the keyboard.
-	context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	keymap = xkb_keymap_new_from_names(context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-	wlr_keyboard_set_keymap(keyboard, keymap);
-	xkb_keymap_unref(keymap);
-	xkb_context_unref(context);
+	// Assign the shared XKB keymap to the keyboard, the keyboard takes its
+	// own reference
+	if ((keymap = keymap_get(NULL)))
+		wlr_keyboard_set_keymap(keyboard, keymap);
 	wlr_keyboard_set_repeat_info(keyboard, 25, 600);
 
 	// Here we set up listeners for keyboard events. 
@@ -540,12 +493,43 @@ void inputdevice(struct wl_listener *listener, void *data) {
 	wlr_seat_set_capabilities(server->seat, caps);
 }
 
+static int focus_delayed(void *data) {
+	struct Client *c = server->pointerc;
+
+	// The pointer stayed in the client it entered
+	if (c && !client_has_focus(c))
+		client_focus(c, 0);
+	return 0;
+}
+
+static void focus_entered(struct Client *c) {
+	// The pointer crossed into c, which is not focused
+	switch (FOCUS_POLICY) {
+	case FocusFollowMouse:
+		client_focus(c, 0);
+		break;
+	case FocusDelayed:
+		if (!server->focus_timer)
+			server->focus_timer = wl_event_loop_add_timer(
+					wl_display_get_event_loop(server->display), focus_delayed, NULL);
+		wl_event_source_timer_update(server->focus_timer, FOCUS_DELAY_MS);
+		break;
+	}
+}
+
 void pointerfocus(struct Client *c, struct wlr_surface *surface, double sx, double sy, uint32_t time) {
 	struct timespec now;
 	int internal_call = !time;
 
-	if (!internal_call && c) {
-		client_focus(c, 0);
+	// The focus policy only looks at crossings into another client, moving
+	// within one costs nothing here. Internal calls after a layout change
+	// leave the crossing to the next real motion.
+	if (!internal_call && c != server->pointerc) {
+		server->pointerc = c;
+		if (server->focus_timer)
+			wl_event_source_timer_update(server->focus_timer, 0);
+		if (c && !client_has_focus(c))
+			focus_entered(c);
 	}
 
 	// If surface is NULL, clear pointer focus 
@@ -0,0 +1,390 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+
+/*
+ * Control socket at $XDG_RUNTIME_DIR/wm.$WAYLAND_DISPLAY.sock, exported to
+ * children as WM_IPC. The protocol is one request per line:
+ *
+ *   subscribe <event>...      focus, tags, title, monitor, layout or all
+ *   view <tagmask>
+ *   tag <tagmask>
+ *   incnmaster <delta>
+ *   togglefullscreen
+ *   monitor_focus left|right|up|down
+ *   state                     "ok" comes with the fd of the state page
+ *   reload                    read the bindings and rules files again
+ *   latency                   scanout and composite frame counts and the
+ *                             latency histograms of each output as with
+ *                             SIGUSR1, before the "ok"
+ *
+ * Every request is answered with "ok" or "error <reason>". Subscribers get
+ * the current state right away, then the status lines (see status.c) of
+ * their events as they change. Output is queued and written without
+ * blocking, a client that lets IPC_MAX_QUEUE bytes pile up is dropped.
+ */
+
+#define IPC_MAX_QUEUE (1 << 20)
+
+struct ipc_client {
+	int fd;
+	struct wl_event_source *source;
+	uint32_t events;
+	char in[512];
+	size_t inlen;
+	char *out;
+	size_t outlen, outcap;
+	int dead; // stopped reading, dropped on the next flush
+	size_t pass_at; // out offset the state page fd goes along with
+	int pass_fd;
+	struct wl_list link;
+};
+
+static const struct {
+	const char *name;
+	uint32_t event;
+} event_names[] = {
+	{"focus", IpcFocus},
+	{"tags", IpcTags},
+	{"title", IpcTitle},
+	{"monitor", IpcMonitor},
+	{"layout", IpcLayout},
+	{"all", IpcFocus | IpcTags | IpcTitle | IpcMonitor | IpcLayout},
+};
+
+static int listen_fd = -1;
+static struct wl_event_source *listen_source;
+static struct sockaddr_un addr;
+static struct wl_list clients;
+
+static void ipc_client_destroy(struct ipc_client *client) {
+	wl_event_source_remove(client->source);
+	close(client->fd);
+	if (client->pass_fd >= 0)
+		close(client->pass_fd);
+	wl_list_remove(&client->link);
+	free(client->out);
+	free(client);
+}
+
+static ssize_t ipc_client_send_fd(struct ipc_client *client, size_t len) {
+	// SCM_RIGHTS needs at least one byte to travel with
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov = {.iov_base = client->out, .iov_len = len};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	ssize_t n;
+
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &client->pass_fd, sizeof(int));
+	if ((n = sendmsg(client->fd, &msg, 0)) > 0) {
+		close(client->pass_fd);
+		client->pass_fd = -1;
+	}
+	return n;
+}
+
+static int ipc_client_write(struct ipc_client *client) {
+	// Returns 0 once the client had to be dropped
+	ssize_t n;
+
+	if (client->dead) {
+		wlr_log(WLR_ERROR, "ipc: client stopped reading, dropping it");
+		ipc_client_destroy(client);
+		return 0;
+	}
+	while (client->outlen) {
+		if (client->pass_fd < 0)
+			n = write(client->fd, client->out, client->outlen);
+		else if (client->pass_at)
+			n = write(client->fd, client->out, client->pass_at);
+		else
+			n = ipc_client_send_fd(client, client->outlen);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n < 0) {
+			ipc_client_destroy(client);
+			return 0;
+		}
+		memmove(client->out, client->out + n, client->outlen - n);
+		client->outlen -= n;
+		if (client->pass_fd >= 0)
+			client->pass_at -= n;
+	}
+	wl_event_source_fd_update(client->source,
+			WL_EVENT_READABLE | (client->outlen ? WL_EVENT_WRITABLE : 0));
+	return 1;
+}
+
+static void ipc_client_queue(const char *line, void *data) {
+	struct ipc_client *client = data;
+	size_t len = strlen(line);
+
+	if (client->dead)
+		return;
+	if (client->outlen + len > IPC_MAX_QUEUE) {
+		client->dead = 1;
+		return;
+	}
+	if (client->outlen + len > client->outcap) {
+		client->outcap = MAX(client->outcap * 2, client->outlen + len);
+		client->out = erealloc(client->out, client->outcap);
+	}
+	memcpy(client->out + client->outlen, line, len);
+	client->outlen += len;
+}
+
+static uint32_t parse_mask(const char *arg, int *ok) {
+	char *end;
+	unsigned long mask = arg ? strtoul(arg, &end, 0) : 0;
+
+	*ok = arg && *arg && !*end;
+	return mask;
+}
+
+static const char *ipc_command(struct ipc_client *client, char *line) {
+	// Returns an error message or NULL
+	char *save, *cmd = strtok_r(line, " \t", &save);
+	char *arg = strtok_r(NULL, " \t", &save);
+	uint32_t events = 0;
+	char *buf = NULL;
+	size_t i, len = 0;
+	FILE *f;
+	int ok;
+
+	if (!cmd)
+		return "empty request";
+
+	if (!strcmp(cmd, "subscribe")) {
+		for (; arg; arg = strtok_r(NULL, " \t", &save)) {
+			for (i = 0; i < LENGTH(event_names); i++)
+				if (!strcmp(arg, event_names[i].name))
+					break;
+			if (i == LENGTH(event_names))
+				return "unknown event";
+			events |= event_names[i].event;
+		}
+		ipc_client_queue("ok\n", client);
+		// Only what is new to this client
+		status_snapshot(events & ~client->events, ipc_client_queue, client);
+		client->events |= events;
+		return NULL;
+	}
+
+	if (!strcmp(cmd, "state")) {
+		if (state_fd() < 0)
+			return "no state page";
+		if (client->pass_fd >= 0)
+			return "state page already on its way";
+		// Our own fd stays open for the next reader
+		if ((client->pass_fd = fcntl(state_fd(), F_DUPFD_CLOEXEC, 0)) < 0)
+			return "out of file descriptors";
+		client->pass_at = client->outlen;
+		ipc_client_queue("ok\n", client);
+		return NULL;
+	}
+
+	if (!strcmp(cmd, "latency")) {
+		if (!(f = open_memstream(&buf, &len)))
+			return "out of memory";
+		latency_dump(f);
+		fclose(f);
+		if (len)
+			ipc_client_queue(buf, client);
+		free(buf);
+		ipc_client_queue("ok\n", client);
+		return NULL;
+	}
+
+	if (!strcmp(cmd, "reload")) {
+		if (bindings_reload() < 0)
+			return "bindings file has errors, see the log";
+		if (rules_reload() < 0)
+			return "rules file has errors, see the log";
+		ipc_client_queue("ok\n", client);
+		return NULL;
+	}
+
+	if (!server->selmon)
+		return "no monitor";
+	if (!strcmp(cmd, "view")) {
+		events = parse_mask(arg, &ok);
+		if (!ok)
+			return "usage: view <tagmask>";
+		view(events);
+	} else if (!strcmp(cmd, "tag")) {
+		events = parse_mask(arg, &ok);
+		if (!ok || !(events & TAGMASK))
+			return "usage: tag <tagmask>";
+		tag(events);
+	} else if (!strcmp(cmd, "incnmaster")) {
+		if (!arg)
+			return "usage: incnmaster <delta>";
+		incnmaster(atoi(arg));
+	} else if (!strcmp(cmd, "togglefullscreen")) {
+		togglefullscreen();
+	} else if (!strcmp(cmd, "monitor_focus")) {
+		if (!arg)
+			return "usage: monitor_focus left|right|up|down";
+		else if (!strcmp(arg, "left"))
+			monitor_focus(WLR_DIRECTION_LEFT);
+		else if (!strcmp(arg, "right"))
+			monitor_focus(WLR_DIRECTION_RIGHT);
+		else if (!strcmp(arg, "up"))
+			monitor_focus(WLR_DIRECTION_UP);
+		else if (!strcmp(arg, "down"))
+			monitor_focus(WLR_DIRECTION_DOWN);
+		else
+			return "usage: monitor_focus left|right|up|down";
+	} else {
+		return "unknown command";
+	}
+
+	ipc_client_queue("ok\n", client);
+	return NULL;
+}
+
+static int ipc_client_event(int fd, uint32_t mask, void *data) {
+	struct ipc_client *client = data;
+	char line[sizeof(client->in) + 16], *nl;
+	const char *err;
+	size_t len;
+	ssize_t n;
+
+	if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+		ipc_client_destroy(client);
+		return 0;
+	}
+	if (mask & WL_EVENT_WRITABLE && !ipc_client_write(client))
+		return 0;
+	if (!(mask & WL_EVENT_READABLE))
+		return 0;
+
+	n = read(fd, client->in + client->inlen, sizeof(client->in) - client->inlen);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+		ipc_client_destroy(client);
+		return 0;
+	}
+	if (n > 0)
+		client->inlen += n;
+
+	while ((nl = memchr(client->in, '\n', client->inlen))) {
+		*nl = '\0';
+		len = nl - client->in + 1;
+		if ((err = ipc_command(client, client->in))) {
+			snprintf(line, sizeof(line), "error %s\n", err);
+			ipc_client_queue(line, client);
+		}
+		memmove(client->in, client->in + len, client->inlen - len);
+		client->inlen -= len;
+	}
+	if (client->inlen == sizeof(client->in)) {
+		wlr_log(WLR_ERROR, "ipc: request too long, dropping client");
+		ipc_client_destroy(client);
+		return 0;
+	}
+
+	// Commands usually changed the status too, that goes out with the
+	// status flush in the same iteration
+	printstatus();
+	return 0;
+}
+
+static int ipc_accept(int fd, uint32_t mask, void *data) {
+	struct ipc_client *client;
+	int cfd;
+
+	if ((cfd = accept(fd, NULL, NULL)) < 0)
+		return 0;
+	fcntl(cfd, F_SETFD, FD_CLOEXEC);
+	fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+	client = ecalloc(1, sizeof(*client));
+	client->fd = cfd;
+	client->pass_fd = -1;
+	client->source = wl_event_loop_add_fd(wl_display_get_event_loop(server->display),
+			cfd, WL_EVENT_READABLE, ipc_client_event, client);
+	wl_list_insert(&clients, &client->link);
+	return 0;
+}
+
+void ipc_init(const char *display) {
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	wl_list_init(&clients);
+	addr.sun_family = AF_UNIX;
+	if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/wm.%s.sock", dir, display)
+			>= (int)sizeof(addr.sun_path)) {
+		wlr_log(WLR_ERROR, "ipc: socket path too long, IPC disabled");
+		return;
+	}
+
+	unlink(addr.sun_path);
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+			|| fcntl(listen_fd, F_SETFD, FD_CLOEXEC) < 0
+			|| fcntl(listen_fd, F_SETFL, O_NONBLOCK) < 0
+			|| bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(listen_fd, 16) < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: cannot listen on %s", addr.sun_path);
+		if (listen_fd >= 0)
+			close(listen_fd);
+		listen_fd = -1;
+		return;
+	}
+	listen_source = wl_event_loop_add_fd(wl_display_get_event_loop(server->display),
+			listen_fd, WL_EVENT_READABLE, ipc_accept, NULL);
+	setenv("WM_IPC", addr.sun_path, 1);
+	wlr_log(WLR_INFO, "IPC socket %s", addr.sun_path);
+}
+
+void ipc_finish(void) {
+	struct ipc_client *client, *tmp;
+
+	if (listen_fd < 0)
+		return;
+	wl_list_for_each_safe(client, tmp, &clients, link)
+		ipc_client_destroy(client);
+	wl_event_source_remove(listen_source);
+	close(listen_fd);
+	unlink(addr.sun_path);
+}
+
+void ipc_broadcast(uint32_t event, const char *line) {
+	struct ipc_client *client;
+
+	if (listen_fd < 0)
+		return;
+	wl_list_for_each(client, &clients, link)
+		if (client->events & event)
+			ipc_client_queue(line, client);
+}
+
+void ipc_flush(void) {
+	// One write per client for everything queued during this iteration
+	struct ipc_client *client, *tmp;
+
+	if (listen_fd < 0)
+		return;
+	wl_list_for_each_safe(client, tmp, &clients, link)
+		if (client->outlen || client->dead)
+			ipc_client_write(client);
+}
@@ -0,0 +1,144 @@
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_compositor.h>
+#include "wm.h"
+
+/*
+ * Input-to-present latency tracer. The first input sent to a surface is
+ * remembered until the client answers it with a commit. The commit is then
+ * followed on the client's output until the frame that contains it has been
+ * presented. Each output keeps a histogram per stage, SIGUSR1 dumps them to
+ * stderr and the IPC latency request to the asking client.
+ */
+
+static const char *stage_names[] = {
+	[LatCommit] = "input-commit",
+	[LatPresent] = "input-present",
+};
+
+static struct {
+	uint64_t input; // ns, 0 when nothing is pending
+	struct wlr_surface *surface; // root surface the input went to
+} probe;
+
+static struct wl_event_source *dump_source;
+
+static uint64_t now_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void latency_record(struct latency_hist *h, uint64_t ns) {
+	uint64_t bucket = ns / LATENCY_BUCKET_NS;
+
+	h->bucket[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS]++;
+	h->count++;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+static double latency_percentile(const struct latency_hist *h, unsigned int pct) {
+	unsigned long want = (h->count * pct + 99) / 100, seen = 0;
+	size_t i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		if ((seen += h->bucket[i]) >= want)
+			return (i + 1) * LATENCY_BUCKET_NS / 1e6;
+	}
+	// Lands in the overflow bucket, max is the best we know
+	return h->max / 1e6;
+}
+
+void latency_dump(FILE *f) {
+	struct Monitor *m;
+	const struct latency_hist *h;
+	size_t i;
+
+	wl_list_for_each(m, &server->monitors, link) {
+		// How commitmon() saw its frames go out
+		fprintf(f, "%s frames scanout=%lu composite=%lu\n", m->wlr_output->name,
+				m->scanout_frames, m->composite_frames);
+		for (i = 0; i < LENGTH(m->latency); i++) {
+			h = &m->latency[i];
+			if (!h->count)
+				continue;
+			fprintf(f, "%s %s n=%lu p50=%.1fms p99=%.1fms max=%.1fms\n",
+					m->wlr_output->name, stage_names[i], h->count,
+					latency_percentile(h, 50), latency_percentile(h, 99),
+					h->max / 1e6);
+		}
+	}
+	fflush(f);
+}
+
+static int handlesigusr1(int signo, void *data) {
+	latency_dump(stderr);
+	prof_dump(stderr);
+	return 0;
+}
+
+void latency_init(void) {
+	dump_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->display),
+			SIGUSR1, handlesigusr1, NULL);
+}
+
+void latency_finish(void) {
+	if (dump_source)
+		wl_event_source_remove(dump_source);
+}
+
+void latency_input(uint32_t time_msec, struct wlr_surface *surface) {
+	uint64_t now = now_ns(), when = time_msec * 1000000ull;
+
+	if (!surface)
+		return;
+	// An input that was never answered (motion over a window that does not
+	// redraw) must not be charged to a later, unrelated commit
+	if (probe.input && now - probe.input < LATENCY_STALE_NS)
+		return;
+
+	// Event times come from the kernel's monotonic clock on real hardware,
+	// other backends may use anything
+	if (!time_msec || when > now || now - when > LATENCY_STALE_NS)
+		when = now;
+	probe.input = when;
+	probe.surface = wlr_surface_get_root_surface(surface);
+}
+
+void latency_forget(struct wlr_surface *surface) {
+	if (probe.surface == surface)
+		probe.input = 0;
+}
+
+void latency_commit(struct Client *c) {
+	struct Monitor *m = c->mon;
+
+	if (!probe.input || probe.surface != client_surface(c))
+		return;
+	if (m) {
+		latency_record(&m->latency[LatCommit], now_ns() - probe.input);
+		// Keep following the oldest commit if the previous one is not on
+		// screen yet
+		if (!m->latency_input)
+			m->latency_input = probe.input;
+	}
+	probe.input = 0;
+}
+
+void latency_output_commit(struct Monitor *m) {
+	if (m->latency_input)
+		m->latency_rendered = 1;
+}
+
+void latency_present(struct Monitor *m, const struct timespec *when) {
+	if (!m->latency_rendered)
+		return;
+	latency_record(&m->latency[LatPresent],
+			when->tv_sec * 1000000000ull + when->tv_nsec - m->latency_input);
+	m->latency_input = 0;
+	m->latency_rendered = 0;
+}
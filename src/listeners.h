@@ -45,6 +45,8 @@ void cleanupkeyboard(struct wl_listener *listener, void *data);
 
 void cleanupmon(struct wl_listener *listener, void *data);
 
+void commitmon(struct wl_listener *listener, void *data);
+
 void commitlayersurfacenotify(struct wl_listener *listener, void *data);
 
 void commitnotify(struct wl_listener *listener, void *data);
@@ -57,6 +59,8 @@ void maplayersurfacenotify(struct wl_listener *listener, void *data);
 
 void mapnotify(struct wl_listener *listener, void *data);
 
+void presentmon(struct wl_listener *listener, void *data);
+
 void rendermon(struct wl_listener *listener, void *data);
 
 void unlocksession(struct wl_listener *listener, void *data);
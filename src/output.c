@@ -1,12 +1,138 @@
 #include "wm.h"
 
+static int client_cmp_seq(const void *a, const void *b) {
+	const struct Client *ca = *(struct Client *const *)a;
+	const struct Client *cb = *(struct Client *const *)b;
+
+	// Newest first, the same order server->clients is kept in
+	return ca->seq < cb->seq ? 1 : ca->seq > cb->seq ? -1 : 0;
+}
+
+void client_reparent(struct Client *c) {
+	int layer = c->is_fullscreen ? LyrFS : c->is_floating ? LyrFloat : LyrTile;
+	uint32_t tags = c->tags & TAGMASK;
+	int tag = 0, multi = !tags || (tags & (tags - 1));
+
+	if (!c->mon) {
+		wlr_scene_node_reparent(&c->scene->node, server->layers[layer]);
+		wlr_scene_node_set_enabled(&c->scene->node, 0);
+		return;
+	}
+
+	// Clients with exactly one tag are shown and hidden through their tag's
+	// tree, the others are toggled one by one by monitor_update_visible()
+	if (multi)
+		tag = TAGCOUNT;
+	else
+		while (!(tags & 1u << tag))
+			tag++;
+	wlr_scene_node_reparent(&c->scene->node, c->mon->tag_trees[layer - LyrTile][tag]);
+	wlr_scene_node_set_enabled(&c->scene->node, !multi || VISIBLEON(c, c->mon));
+	hittest_invalidate();
+}
+
+static void monitor_update_visible(struct Monitor *m) {
+	uint32_t tags = m->tagset[m->seltags], changed = tags ^ m->visible_tags;
+	unsigned int gen;
+	struct wlr_scene_node *node;
+	struct Client *c;
+	int i, l;
+
+	if (!m->visible_dirty && m->visible_tags == tags)
+		return;
+
+	for (l = 0; l < LENGTH(m->tag_trees); l++) {
+		for (i = 0; i < TAGCOUNT; i++)
+			wlr_scene_node_set_enabled(&m->tag_trees[l][i]->node, tags & 1u << i);
+		wl_list_for_each(node, &m->tag_trees[l][TAGCOUNT]->children, link) {
+			c = node->data;
+			wlr_scene_node_set_enabled(node, VISIBLEON(c, m));
+		}
+	}
+
+	gen = ++server->visible_gen;
+	m->nvisible = 0;
+	for (i = 0; i < TAGCOUNT; i++) {
+		if (!(tags & 1u << i))
+			continue;
+		wl_list_for_each(c, &m->tag_clients[i], tlink[i]) {
+			// Clients with several tags sit in several buckets
+			if (c->visible_gen == gen)
+				continue;
+			c->visible_gen = gen;
+			if (m->nvisible == m->visible_cap) {
+				m->visible_cap = m->visible_cap ? m->visible_cap * 2 : 16;
+				m->visible = erealloc(m->visible, m->visible_cap * sizeof(*m->visible));
+			}
+			m->visible[m->nvisible++] = c;
+		}
+	}
+	qsort(m->visible, m->nvisible, sizeof(*m->visible), client_cmp_seq);
+
+	// Clients on tags that were shown or hidden; clients that joined or
+	// changed tags were updated by monitor_attach_client()
+	for (i = 0; i < TAGCOUNT; i++) {
+		if (!(changed & 1u << i))
+			continue;
+		wl_list_for_each(c, &m->tag_clients[i], tlink[i])
+			client_set_suspended(c, c->visible_gen != gen);
+	}
+
+	m->visible_tags = tags;
+	m->visible_dirty = 0;
+}
+
+struct Client **monitor_visible_clients(struct Monitor *m, size_t *n) {
+	monitor_update_visible(m);
+	*n = m->nvisible;
+	return m->visible;
+}
+
+static void monitor_attach_client(struct Client *c) {
+	struct Monitor *m = c->mon;
+	int i;
+
+	for (i = 0; i < TAGCOUNT; i++) {
+		if (c->tags & 1u << i) {
+			wl_list_insert(&m->tag_clients[i], &c->tlink[i]);
+			m->tag_urgent[i] += c->is_urgent;
+		}
+	}
+	m->visible_dirty = 1;
+	client_reparent(c);
+	client_set_suspended(c, !VISIBLEON(c, m));
+}
+
+static void monitor_detach_client(struct Client *c) {
+	int i;
+
+	if (!c->mon)
+		return;
+	for (i = 0; i < TAGCOUNT; i++) {
+		if (c->tags & 1u << i) {
+			wl_list_remove(&c->tlink[i]);
+			c->mon->tag_urgent[i] -= c->is_urgent;
+		}
+	}
+	c->mon->visible_dirty = 1;
+}
+
+void monitor_retag_client(struct Client *c, uint32_t tags) {
+	monitor_detach_client(c);
+	c->tags = tags;
+	if (c->mon)
+		monitor_attach_client(c);
+}
+
 static void monitor_tile_clients(struct Monitor *m) {
 	unsigned int i, n = 0, mw, my, ty;
-	struct Client *c;
+	size_t j, nvisible;
+	struct Client *c, **visible;
 	const int pixel_gap = 8;
 
-	wl_list_for_each(c, &server->clients, link) {
-		if (VISIBLEON(c, m) && !c->is_fullscreen) {
+	visible = monitor_visible_clients(m, &nvisible);
+	for (j = 0; j < nvisible; j++) {
+		if (!visible[j]->is_fullscreen) {
 			n++;
 		}
 	}
@@ -22,8 +148,9 @@ static void monitor_tile_clients(struct Monitor *m) {
 	}
 
 	i = my = ty = 0;
-	wl_list_for_each(c, &server->clients, link) {
-		if (!VISIBLEON(c, m) || c->is_fullscreen)
+	for (j = 0; j < nvisible; j++) {
+		c = visible[j];
+		if (c->is_fullscreen)
 			continue;
 		if (i < m->nmaster) {
 			struct wlr_box box = {
@@ -48,23 +175,155 @@ static void monitor_tile_clients(struct Monitor *m) {
 	}
 }
 
-void monitor_arrange(struct Monitor *m) {
+static void monitor_txn_commit(struct Monitor *m) {
+	struct Client *c, *tmp;
+
+	wl_list_for_each_safe(c, tmp, &m->txn_clients, txn_link) {
+		wl_list_remove(&c->txn_link);
+		wl_list_init(&c->txn_link);
+		client_apply_geometry(c);
+	}
+	if (m->txn_armed) {
+		wl_event_source_timer_update(m->txn_timer, 0);
+		m->txn_armed = 0;
+	}
+	motionnotify(0);
+}
+
+static int monitor_txn_ready(struct Monitor *m) {
 	struct Client *c;
-	wl_list_for_each(c, &server->clients, link)
-		if (c->mon == m)
-			wlr_scene_node_set_enabled(&c->scene->node, VISIBLEON(c, m));
 
-	wlr_scene_node_set_enabled(&m->fullscreen_bg->node,
-			(c = monitor_get_top_client(m)) && c->is_fullscreen);
+	if (!m->pending_resizes)
+		return 1;
+	// Stopped clients will never answer, don't wait for them
+	wl_list_for_each(c, &m->txn_clients, txn_link)
+		if (c->resize && !client_is_stopped(c))
+			return 0;
+	return 1;
+}
+
+static int monitor_txn_timeout(void *data) {
+	struct Monitor *m = data;
+
+	wlr_log(WLR_DEBUG, "%s: clients did not resize within %d ms",
+			m->wlr_output->name, TXN_TIMEOUT_MS);
+	m->txn_armed = 0;
+	monitor_txn_commit(m);
+	return 0;
+}
+
+int monitor_txn_defer(struct Monitor *m, struct Client *c) {
+	int waits = c->resize && !client_is_stopped(c);
+
+	// Nothing in flight, the new geometry can be shown right away
+	if (!waits && !m->txn_batch && wl_list_empty(&m->txn_clients))
+		return 0;
 
+	if (waits && !c->saved)
+		client_save_buffers(c);
+	if (wl_list_empty(&c->txn_link))
+		wl_list_insert(m->txn_clients.prev, &c->txn_link);
+	if (waits && !m->txn_armed) {
+		wl_event_source_timer_update(m->txn_timer, TXN_TIMEOUT_MS);
+		m->txn_armed = 1;
+	}
+	return 1;
+}
+
+void monitor_txn_check(struct Monitor *m) {
+	if (!m->txn_batch && !wl_list_empty(&m->txn_clients) && monitor_txn_ready(m))
+		monitor_txn_commit(m);
+}
+
+void monitor_txn_drop(struct Client *c) {
+	// The client leaves its monitor, show its latest geometry and let the
+	// others go ahead without it
+	if (wl_list_empty(&c->txn_link))
+		return;
+	wl_list_remove(&c->txn_link);
+	wl_list_init(&c->txn_link);
+	client_apply_geometry(c);
+	monitor_txn_check(c->mon);
+}
+
+struct wlr_scene_tree *monitor_layer_tree(struct Monitor *m, int layer) {
+	return m && layer < LENGTH(m->layer_trees) ? m->layer_trees[layer] : server->layers[layer];
+}
+
+void monitor_update_fullscreen(struct Monitor *m) {
+	struct Client *c = monitor_get_top_client(m);
+	struct wlr_surface *surface;
+	int fullscreen = c && c->is_fullscreen, opaque = 0;
+	size_t i;
+
+	if (fullscreen != m->fullscreen) {
+		for (i = 0; i < LENGTH(m->layer_trees); i++)
+			wlr_scene_node_set_enabled(&m->layer_trees[i]->node, !fullscreen);
+		m->fullscreen = fullscreen;
+		hittest_invalidate();
+	}
+
+	// The background only has to hide what shows through the client, an
+	// opaque buffer covering the whole monitor needs none
+	if (fullscreen && (surface = client_surface(c))) {
+		opaque = surface->current.width == m->m.width
+			&& surface->current.height == m->m.height
+			&& pixman_region32_contains_rectangle(&surface->opaque_region,
+				&(pixman_box32_t){0, 0, m->m.width, m->m.height}) == PIXMAN_REGION_IN;
+	}
+	if (m->fullscreen_bg->node.enabled != (fullscreen && !opaque)) {
+		wlr_scene_node_set_enabled(&m->fullscreen_bg->node, fullscreen && !opaque);
+		hittest_invalidate();
+	}
+}
+
+static void monitor_arrange_now(struct Monitor *m) {
+	// Also enables the clients shown by the current tagset and hides the rest
+	hittest_invalidate();
+	monitor_update_visible(m);
+	monitor_update_fullscreen(m);
+
+	// Every configure sent by this pass becomes part of one transaction
+	m->txn_batch = 1;
 	monitor_tile_clients(m);
+	m->txn_batch = 0;
+	monitor_txn_check(m);
+}
+
+static void monitor_arrange_flush(void *data) {
+	struct Monitor *m;
+	uint64_t start;
+
+	// The idle source is freed by the event loop once this returns, arrange
+	// requests made from here on schedule a new one
+	server->arrange_idle = NULL;
+
+	wl_list_for_each(m, &server->monitors, link) {
+		if (!m->arrange_pending)
+			continue;
+		m->arrange_pending = 0;
+		start = prof_begin();
+		monitor_arrange_now(m);
+		prof_end(ProfArrange, start);
+	}
+
 	motionnotify(0);
 	checkidleinhibitor(NULL);
 }
 
+void monitor_arrange(struct Monitor *m) {
+	// Only mark the monitor dirty, the actual pass runs once per event loop
+	// iteration no matter how many times a single action asked for it
+	m->arrange_pending = 1;
+	if (!server->arrange_idle)
+		server->arrange_idle = wl_event_loop_add_idle(
+				wl_display_get_event_loop(server->display), monitor_arrange_flush, NULL);
+}
+
 void cleanupmon(struct wl_listener *listener, void *data) {
 	struct Monitor *m = wl_container_of(listener, m, destroy);
 	struct LayerSurface *l, *tmp;
+	struct process *p;
 
 	for (int i = 0; i <= ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY; i++) {
 		wl_list_for_each_safe(l, tmp, &m->layers[i], link) {
@@ -74,13 +333,33 @@ void cleanupmon(struct wl_listener *listener, void *data) {
 
 	wl_list_remove(&m->destroy.link);
 	wl_list_remove(&m->frame.link);
+	wl_list_remove(&m->present.link);
+	wl_list_remove(&m->commit.link);
 	wl_list_remove(&m->link);
+	wl_event_source_remove(m->txn_timer);
+	wl_event_source_remove(m->render_timer);
 	m->wlr_output->data = NULL;
 	wlr_output_layout_remove(server->output_layout, m->wlr_output);
 	wlr_scene_output_destroy(m->scene_output);
 	wlr_scene_node_destroy(&m->fullscreen_bg->node);
+	hittest_invalidate();
+
+	// Windows of processes started on it go to selmon instead
+	wl_list_for_each(p, &server->processes, link)
+		if (p->mon == m)
+			p->mon = NULL;
 
+	// Clients are moved off the tag trees before they go away
 	monitor_close(m);
+	for (int layer = 0; layer < LENGTH(m->tag_trees); layer++) {
+		for (int i = 0; i <= TAGCOUNT; i++) {
+			wlr_scene_node_destroy(&m->tag_trees[layer][i]->node);
+		}
+	}
+	for (int layer = 0; layer < LENGTH(m->layer_trees); layer++)
+		wlr_scene_node_destroy(&m->layer_trees[layer]->node);
+	free(m->visible);
+	status_forget(m);
 	free(m);
 }
 
@@ -99,7 +378,7 @@ void monitor_close(struct Monitor *m) {
 	}
 
 	wl_list_for_each(c, &server->clients, link) {
-		if (c->is_floating && c->geom.x > m->m.width) {
+		if (c->is_floating && !c->pooled && c->geom.x > m->m.width) {
 			client_resize(c, (struct wlr_box){.x = c->geom.x - m->w.width, .y = c->geom.y,
 				.width = c->geom.width, .height = c->geom.height}, 0);
 		}
@@ -112,33 +391,152 @@ void monitor_close(struct Monitor *m) {
 	printstatus();
 }
 
+static void send_frame_done(struct wlr_surface *surface, int sx, int sy, void *data) {
+	wlr_surface_send_frame_done(surface, data);
+}
+
+static long timespec_diff_ns(const struct timespec *a, const struct timespec *b) {
+	return (a->tv_sec - b->tv_sec) * 1000000000L + (a->tv_nsec - b->tv_nsec);
+}
+
+static void monitor_render(struct Monitor *m) {
+	struct Client *c;
+	struct timespec start, now;
+
+	// Clients that are still resizing show their saved buffers, so there is
+	// never a reason to hold back the whole output
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	wlr_scene_output_commit(m->scene_output);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	m->render_cost += (timespec_diff_ns(&now, &start) - m->render_cost) / 8;
+
+	// Let clients know a frame has been rendered
+	wlr_scene_output_send_frame_done(m->scene_output, &now);
+
+	// The scene skips hidden surface trees, but clients drawing their new
+	// size may be waiting for a frame callback
+	wl_list_for_each(c, &m->txn_clients, txn_link)
+		if (c->saved)
+			client_for_each_surface(c, send_frame_done, &now);
+}
+
+static int monitor_render_timeout(void *data) {
+	uint64_t start = prof_begin();
+
+	monitor_render(data);
+	prof_end(ProfRendermon, start);
+	return 0;
+}
+
+static int monitor_render_delay(struct Monitor *m) {
+	// Milliseconds we can still wait for clients before rendering in time
+	// for the next vblank, predicted from the last presentation
+	struct timespec now;
+	long budget, until_vblank;
+
+	if (!m->max_render_time || !m->refresh || !m->last_present.tv_sec)
+		return 0;
+	if (m->max_render_time == MAX_RENDER_TIME_AUTO)
+		// Leave room for the GPU work wlr_scene_output_commit() doesn't wait on
+		budget = 2 * m->render_cost + 1000000;
+	else
+		budget = m->max_render_time * 1000000L;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	until_vblank = m->refresh - timespec_diff_ns(&now, &m->last_present) % m->refresh;
+	return (until_vblank - budget) / 1000000;
+}
+
+void rendermon(struct wl_listener *listener, void *data) {
+	// This function is called every time an output is ready to display a frame,
+	// generally at the output's refresh rate (e.g. 60Hz). Rendering is pushed
+	// as close to the vblank as allowed so late client commits still make it.
+	struct Monitor *m = wl_container_of(listener, m, frame);
+	uint64_t start = prof_begin();
+	int delay = monitor_render_delay(m);
+
+	if (delay < 1)
+		monitor_render(m);
+	else
+		wl_event_source_timer_update(m->render_timer, delay);
+	prof_end(ProfRendermon, start);
+}
+
+void commitmon(struct wl_listener *listener, void *data) {
+	struct Monitor *m = wl_container_of(listener, m, commit);
+	struct wlr_output_event_commit *event = data;
+	struct Client *c;
+	struct wlr_surface *surface;
+	int scanout = 0;
+
+	if (!(event->committed & WLR_OUTPUT_STATE_BUFFER))
+		return;
+	latency_output_commit(m);
+	// Direct scanout hands the client's own buffer to the output
+	if (m->fullscreen && (c = monitor_get_top_client(m))
+			&& (surface = client_surface(c)) && surface->buffer)
+		scanout = event->buffer == &surface->buffer->base;
+
+	if (scanout)
+		m->scanout_frames++;
+	else
+		m->composite_frames++;
+	if (scanout != m->scanout)
+		wlr_log(WLR_DEBUG, "%s: %s (%lu scanout, %lu composited frames)",
+				m->wlr_output->name, scanout ? "direct scanout" : "compositing",
+				m->scanout_frames, m->composite_frames);
+	m->scanout = scanout;
+}
+
+void presentmon(struct wl_listener *listener, void *data) {
+	struct Monitor *m = wl_container_of(listener, m, present);
+	struct wlr_output_event_present *event = data;
+
+	if (!event->presented || !event->when)
+		return;
+	m->last_present = *event->when;
+	m->refresh = event->refresh;
+	latency_present(m, event->when);
+}
+
 void new_monitor_available(struct wl_listener *listener, void *data) {
 	struct wlr_output *wlr_output = data;
-	size_t i;
+	size_t i, j;
 	struct wlr_egl *egl;
 	struct Monitor *m = wlr_output->data = ecalloc(1, sizeof(*m));
 
 	m->wlr_output = wlr_output;
 
 	wlr_output_init_render(wlr_output, server->allocator, server->renderer);
-	egl = wlr_gles2_renderer_get_egl(server->renderer);
-	if (!eglMakeCurrent(wlr_egl_get_display(egl), EGL_NO_SURFACE, EGL_NO_SURFACE, wlr_egl_get_context(egl))) {
-		wlr_log(WLR_ERROR, "yea uhhhh something went wrong with the whole EGL thing here??? you're kinda on your own :)");
-		free(m);
-		return;
-	}
+	// The pixman renderer (headless, WLR_RENDERER=pixman) has no EGL context
+	if (wlr_renderer_is_gles2(server->renderer)) {
+		egl = wlr_gles2_renderer_get_egl(server->renderer);
+		if (!eglMakeCurrent(wlr_egl_get_display(egl), EGL_NO_SURFACE, EGL_NO_SURFACE, wlr_egl_get_context(egl))) {
+			wlr_log(WLR_ERROR, "yea uhhhh something went wrong with the whole EGL thing here??? you're kinda on your own :)");
+			free(m);
+			return;
+		}
 
-	wlr_log(WLR_INFO, "Binding new stuffes to the monitor!");
+		wlr_log(WLR_INFO, "Binding new stuffes to the monitor!");
 
-	if (!eglMakeCurrent(wlr_egl_get_display(egl), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT)) {
-		wlr_log(WLR_ERROR, "Failed to do the freeing of the egl context! This is definitely not supposed to happen!!! :)");
-		free(m);
-		return;
+		if (!eglMakeCurrent(wlr_egl_get_display(egl), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT)) {
+			wlr_log(WLR_ERROR, "Failed to do the freeing of the egl context! This is definitely not supposed to happen!!! :)");
+			free(m);
+			return;
+		}
 	}
 
 	// Initialize monitor state using configured rules 
 	for (i = 0; i < LENGTH(m->layers); i++)
 		wl_list_init(&m->layers[i]);
+	for (i = 0; i < LENGTH(m->tag_clients); i++)
+		wl_list_init(&m->tag_clients[i]);
+	wl_list_init(&m->txn_clients);
+	m->txn_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->display),
+			monitor_txn_timeout, m);
+	m->render_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->display),
+			monitor_render_timeout, m);
+	m->max_render_time = MAX_RENDER_TIME;
 	m->tagset[0] = m->tagset[1] = 1;
 
 	m->mfact = 0.5f;
@@ -157,6 +555,8 @@ void new_monitor_available(struct wl_listener *listener, void *data) {
 
 	// Set up eventlisteners 
 	LISTEN(&wlr_output->events.frame, &m->frame, rendermon);
+	LISTEN(&wlr_output->events.present, &m->present, presentmon);
+	LISTEN(&wlr_output->events.commit, &m->commit, commitmon);
 	LISTEN(&wlr_output->events.destroy, &m->destroy, cleanupmon);
 
 	wlr_output_enable(wlr_output, 1);
@@ -171,6 +571,17 @@ void new_monitor_available(struct wl_listener *listener, void *data) {
 	wl_list_insert(&server->monitors, &m->link);
 	printstatus();
 
+	for (i = 0; i < LENGTH(m->layer_trees); i++)
+		m->layer_trees[i] = wlr_scene_tree_create(server->layers[i]);
+	for (i = 0; i < LENGTH(m->tag_trees); i++) {
+		for (j = 0; j <= TAGCOUNT; j++) {
+			m->tag_trees[i][j] = wlr_scene_tree_create(monitor_layer_tree(m, LyrTile + i));
+			wlr_scene_node_set_enabled(&m->tag_trees[i][j]->node,
+					j == TAGCOUNT || m->tagset[m->seltags] & 1u << j);
+		}
+	}
+	m->visible_tags = m->tagset[m->seltags];
+
 	// The xdg-protocol specifies:
 	//
 	// If the fullscreened surface is not opaque, the compositor must make
@@ -180,6 +591,7 @@ void new_monitor_available(struct wl_listener *listener, void *data) {
 	//
 	// updatemons() will resize and set correct position 
 	m->fullscreen_bg = wlr_scene_rect_create(server->layers[LyrFS], 0, 0, (float[]){0.1f, 0.1f, 0.1f, 1.0f});
+	wlr_scene_node_lower_to_bottom(&m->fullscreen_bg->node);
 	wlr_scene_node_set_enabled(&m->fullscreen_bg->node, 0);
 
 	// Adds this to the output layout in the order it was configured in.
@@ -224,6 +636,7 @@ void monitor_arrange_layers(struct Monitor *m) {
 
 	if (!m->wlr_output->enabled)
 		return;
+	hittest_invalidate();
 
 	// Arrange exclusive surfaces from top to bottom
 	for (i = 3; i >= 0; i--) {
@@ -266,29 +679,6 @@ struct Client *monitor_get_top_client(struct Monitor *m) {
 	return NULL;
 }
 
-void rendermon(struct wl_listener *listener, void *data) {
-	// This function is called every time an output is ready to display a frame,
-	// generally at the output's refresh rate (e.g. 60Hz).
-	struct Monitor *m = wl_container_of(listener, m, frame);
-	struct Client *c;
-	struct timespec now;
-
-	// Render if no XDG clients have an outstanding resize and are visible on
-	// this monitor.
-	wl_list_for_each(c, &server->clients, link) {
-		if (c->resize && !c->is_floating && client_is_rendered_on_mon(c, m) && !client_is_stopped(c)) {
-			goto skip;
-		}
-	}
-
-	wlr_scene_output_commit(m->scene_output);
-
-skip:
-	// Let clients know a frame has been rendered
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	wlr_scene_output_send_frame_done(m->scene_output, &now);
-}
-
 struct Monitor *monitor_get_by_direction(enum wlr_direction dir) {
 	struct wlr_output *next;
 	if (!wlr_output_layout_get(server->output_layout, server->selmon->wlr_output)) {
@@ -314,8 +704,18 @@ void monitor_set(struct Client *c, struct Monitor *m, uint32_t newtags) {
 
 	if (oldmon == m)
 		return;
+	monitor_txn_drop(c);
+	monitor_detach_client(c);
+	if (c->resize && !c->is_floating) {
+		if (oldmon)
+			oldmon->pending_resizes--;
+		if (m)
+			m->pending_resizes++;
+	}
 	c->mon = m;
 	c->prev = c->geom;
+	if (!m)
+		client_reparent(c); // off the old monitor's tag trees
 
 	// TODO leave/enter is not optimal but works
 	if (oldmon) {
@@ -327,6 +727,7 @@ void monitor_set(struct Client *c, struct Monitor *m, uint32_t newtags) {
 		client_resize(c, c->geom, 0);
 		wlr_surface_send_enter(client_surface(c), m->wlr_output);
 		c->tags = newtags ? newtags : m->tagset[m->seltags]; // assign tags of target monitor
+		monitor_attach_client(c);
 		setfullscreen(c, c->is_fullscreen); // This will call arrange(c->mon)
 	}
 	client_focus(monitor_get_top_client(server->selmon), 1);
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+
+/*
+ * Warm pool: a few instances of the most used programs are started ahead of
+ * time and kept mapped but hidden, pool_take() shows one of them on the
+ * current tags and starts a replacement from the event loop. The instance
+ * was configured to the size of the monitor long before and has drawn at
+ * it, so it shows up with the next frame instead of after process start and
+ * first commit.
+ *
+ * Windows are matched to their instance by the pid of the wayland client,
+ * commands run with exec so the shell does not sit in between. Programs that
+ * hand their windows to a server process (footclient) cannot be pooled like
+ * that, pool the standalone variant instead. When nothing is warm the cold
+ * command runs, which can be the cheaper client of such a server. Launchers
+ * drawn as layer surfaces cannot be hidden without being unmapped and are
+ * not pooled.
+ */
+
+#define POOL_MAX 4 // instances per program at most
+#define POOL_LOSSES 3 // waiting windows lost before refilling stops
+
+static const struct pool_app {
+	const char *name; // what the pool binding asks for
+	const char *cmd; // pooled instances
+	const char *cold; // started when none is ready
+	int size; // instances kept waiting
+} pool_apps[] = {
+	{"terminal", "/usr/bin/foot", "/usr/bin/footclient", 1},
+};
+
+static struct {
+	pid_t pending[POOL_MAX]; // spawned, no window yet
+	struct Client *ready[POOL_MAX];
+	int npending, nready;
+	int lost; // windows unmapped while waiting since the last pool_take()
+} pools[LENGTH(pool_apps)];
+
+static struct wl_event_source *fill_idle;
+
+static void pool_exited(struct process *process, int status, void *data) {
+	// Died before it mapped a window, it is not started again until the
+	// next pool_take() so a broken command does not spin
+	size_t i = (struct pool_app *)data - pool_apps;
+	int j;
+
+	for (j = 0; j < pools[i].npending; j++)
+		if (pools[i].pending[j] == process->pid) {
+			pools[i].pending[j] = pools[i].pending[--pools[i].npending];
+			return;
+		}
+}
+
+static void pool_fill(void *data) {
+	struct process *process;
+	char cmd[256];
+	size_t i;
+
+	fill_idle = NULL;
+	for (i = 0; i < LENGTH(pool_apps); i++) {
+		if (pools[i].lost >= POOL_LOSSES)
+			continue;
+		snprintf(cmd, sizeof(cmd), "exec %s", pool_apps[i].cmd);
+		while (pools[i].npending + pools[i].nready < MIN(pool_apps[i].size, POOL_MAX)) {
+			if (!(process = spawn(cmd, -1, STDERR_FILENO, &server->processes,
+					server->activation, server->seat)))
+				break;
+			process->exited = pool_exited;
+			process->data = (void *)&pool_apps[i];
+			pools[i].pending[pools[i].npending++] = process->pid;
+		}
+	}
+}
+
+static void pool_schedule(void) {
+	if (WARM_POOL && !fill_idle)
+		fill_idle = wl_event_loop_add_idle(wl_display_get_event_loop(server->display),
+				pool_fill, NULL);
+}
+
+int pool_adopt(struct Client *c) {
+	// Returns 1 if the newly mapped c belongs to the pool, it is then kept
+	// without a monitor until taken
+	pid_t pid;
+	size_t i;
+	int j;
+
+	wl_client_get_credentials(c->surface->client->client, &pid, NULL, NULL);
+	for (i = 0; i < LENGTH(pool_apps); i++)
+		for (j = 0; j < pools[i].npending; j++) {
+			if (pools[i].pending[j] != pid)
+				continue;
+			pools[i].pending[j] = pools[i].pending[--pools[i].npending];
+			pools[i].ready[pools[i].nready++] = c;
+			c->pooled = 1;
+			c->is_floating = client_is_float_type(c);
+			client_reparent(c);
+			client_set_suspended(c, 1);
+			// Drawn at the size it most likely gets, alone on the tag
+			if (server->selmon)
+				client_resize(c, server->selmon->w, 1);
+			wlr_log(WLR_INFO, "pool: %s (%d) ready", pool_apps[i].name, pid);
+			return 1;
+		}
+	return 0;
+}
+
+void pool_forget(struct Client *c) {
+	// Unmapped while still waiting. A program that keeps closing its hidden
+	// window is not started again until the next pool_take(), like one that
+	// dies before mapping, so it does not spin
+	size_t i;
+	int j;
+
+	for (i = 0; i < LENGTH(pool_apps); i++)
+		for (j = 0; j < pools[i].nready; j++)
+			if (pools[i].ready[j] == c) {
+				memmove(&pools[i].ready[j], &pools[i].ready[j + 1],
+						(--pools[i].nready - j) * sizeof(pools[i].ready[0]));
+				c->pooled = 0;
+				if (++pools[i].lost == POOL_LOSSES)
+					wlr_log(WLR_ERROR, "pool: %s keeps closing, not refilled",
+							pool_apps[i].name);
+				pool_schedule();
+				return;
+			}
+}
+
+void pool_take(const char *name) {
+	struct Client *c;
+	size_t i;
+
+	for (i = 0; i < LENGTH(pool_apps); i++)
+		if (!strcmp(pool_apps[i].name, name))
+			break;
+	if (i == LENGTH(pool_apps)) {
+		wlr_log(WLR_ERROR, "pool: no program called %s", name);
+		return;
+	}
+
+	pools[i].lost = 0;
+	if (!pools[i].nready || !server->selmon) {
+		// Nothing warm yet, start it the slow way
+		process_place_here(spawn(pool_apps[i].cold, -1, STDERR_FILENO,
+				&server->processes, server->activation, server->seat));
+		pool_schedule();
+		return;
+	}
+
+	// Oldest first, it had the most time to settle
+	c = pools[i].ready[0];
+	memmove(&pools[i].ready[0], &pools[i].ready[1],
+			--pools[i].nready * sizeof(pools[i].ready[0]));
+	c->pooled = 0;
+	applyrules(c);
+	client_focus(c, 1);
+	printstatus();
+	pool_schedule();
+}
+
+void pool_init(void) {
+	// Started once the event loop runs, after the autostart entries
+	pool_schedule();
+}
+
+void pool_finish(void) {
+	struct process *process;
+	size_t i;
+
+	if (fill_idle)
+		wl_event_source_remove(fill_idle);
+	// Children still starting outlive us, their windows have nowhere to go
+	wl_list_for_each(process, &server->processes, link)
+		for (i = 0; i < LENGTH(pool_apps); i++)
+			if (process->data == &pool_apps[i])
+				process->exited = NULL;
+}
@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+
+/*
+ * Tracks whether the processes behind our clients are stopped, continued or
+ * gone so client_is_stopped() never has to ask the kernel from the render
+ * path. Exits are reported by a pidfd per process, stops and continues of
+ * our own children by SIGCHLD.
+ */
+
+static struct wl_event_source *sigchld_source;
+
+static void procstate_update(struct procstate *p) {
+	siginfo_t in = {0};
+
+	if (!p->child || p->exited)
+		return;
+	// Consume the stop/continue notification, exits are left for reaping
+	if (waitid(P_PID, p->pid, &in, WNOHANG|WSTOPPED|WCONTINUED) < 0) {
+		if (errno == ECHILD)
+			p->exited = 1;
+		return;
+	}
+	if (!in.si_pid)
+		return;
+	if (in.si_code == CLD_STOPPED || in.si_code == CLD_TRAPPED)
+		p->stopped = 1;
+	else if (in.si_code == CLD_CONTINUED)
+		p->stopped = 0;
+}
+
+static int procstate_exited(int fd, uint32_t mask, void *data) {
+	struct procstate *p = data;
+
+	p->exited = 1;
+	wl_event_source_remove(p->source);
+	p->source = NULL;
+	close(p->pidfd);
+	p->pidfd = -1;
+	return 0;
+}
+
+static int handlesigchld(int signo, void *data) {
+	struct procstate *p;
+
+	wl_list_for_each(p, &server->procstates, link)
+		procstate_update(p);
+
+	// Exits are reaped child by child, see subprocess.c
+	process_check();
+	return 0;
+}
+
+void procstate_init(void) {
+	// Blocks SIGCHLD and reads it from a signalfd, spawn() starts children
+	// with a clean signal mask
+	wl_list_init(&server->procstates);
+	sigchld_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->display),
+			SIGCHLD, handlesigchld, NULL);
+	if (!sigchld_source)
+		die("couldn't watch SIGCHLD");
+}
+
+void procstate_finish(void) {
+	wl_event_source_remove(sigchld_source);
+}
+
+struct procstate *procstate_get(pid_t pid) {
+	struct procstate *p;
+	siginfo_t in = {0};
+
+	wl_list_for_each(p, &server->procstates, link) {
+		if (p->pid == pid) {
+			p->refs++;
+			return p;
+		}
+	}
+
+	p = ecalloc(1, sizeof(*p));
+	p->pid = pid;
+	p->refs = 1;
+	p->pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (p->pidfd >= 0)
+		p->source = wl_event_loop_add_fd(wl_display_get_event_loop(server->display),
+				p->pidfd, WL_EVENT_READABLE, procstate_exited, p);
+
+	/* This process is not our child process, while is very unluckely that
+	 * it is stopped, we have no way to tell, so assume that it is. */
+	if (waitid(P_PID, pid, &in, WNOHANG|WNOWAIT|WEXITED|WSTOPPED|WCONTINUED) < 0) {
+		p->stopped = errno == ECHILD;
+	} else {
+		p->child = 1;
+		if (in.si_pid && (in.si_code == CLD_STOPPED || in.si_code == CLD_TRAPPED))
+			p->stopped = 1;
+	}
+
+	wl_list_insert(&server->procstates, &p->link);
+	return p;
+}
+
+void procstate_put(struct procstate *p) {
+	if (!p || --p->refs)
+		return;
+	if (p->source)
+		wl_event_source_remove(p->source);
+	if (p->pidfd >= 0)
+		close(p->pidfd);
+	wl_list_remove(&p->link);
+	free(p);
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "wm.h"
+
+/*
+ * Cheap timers around the paths that scale with the number of clients.
+ * Disabled unless WM_PROFILE is set, in which case the totals are written
+ * to stderr on exit and on SIGUSR1 (see latency.c).
+ */
+
+#define PROF_BUCKETS 40 // power-of-two ns buckets, the last one catches the rest
+
+static const char *prof_names[] = {
+	[ProfArrange] = "monitor_arrange",
+	[ProfXytonode] = "xytonode",
+	[ProfPrintstatus] = "printstatus",
+	[ProfRendermon] = "rendermon",
+};
+
+static struct {
+	unsigned long calls;
+	uint64_t total, max; // ns
+	unsigned long bucket[PROF_BUCKETS];
+} counters[NUM_PROF];
+
+static int enabled;
+
+void prof_init(void) {
+	enabled = getenv("WM_PROFILE") != NULL;
+}
+
+uint64_t prof_begin(void) {
+	struct timespec now;
+
+	if (!enabled)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void prof_end(int id, uint64_t start) {
+	uint64_t ns = prof_begin() - start;
+	int bucket = 0;
+
+	if (!start)
+		return;
+	while (bucket < PROF_BUCKETS - 1 && ns >> (bucket + 1))
+		bucket++;
+	counters[id].bucket[bucket]++;
+	counters[id].calls++;
+	counters[id].total += ns;
+	if (ns > counters[id].max)
+		counters[id].max = ns;
+}
+
+static uint64_t prof_percentile(int id, unsigned int pct) {
+	unsigned long want = (counters[id].calls * pct + 99) / 100, seen = 0;
+	int i;
+
+	// Upper bound of the bucket, good to a factor of two
+	for (i = 0; i < PROF_BUCKETS - 1; i++)
+		if ((seen += counters[id].bucket[i]) >= want)
+			return 2ull << i;
+	return counters[id].max;
+}
+
+void prof_dump(FILE *f) {
+	int i;
+
+	if (!enabled)
+		return;
+	for (i = 0; i < NUM_PROF; i++) {
+		if (!counters[i].calls)
+			continue;
+		fprintf(f, "prof %s calls=%lu avg=%.1fus p50<%.1fus p99<%.1fus max=%.1fus\n",
+				prof_names[i], counters[i].calls,
+				counters[i].total / 1e3 / counters[i].calls,
+				prof_percentile(i, 50) / 1e3, prof_percentile(i, 99) / 1e3,
+				counters[i].max / 1e3);
+	}
+	fflush(f);
+}
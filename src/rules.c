@@ -0,0 +1,418 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+
+/*
+ * Window rules, read from $WM_RULES, else $XDG_CONFIG_HOME/wm/rules or
+ * ~/.config/wm/rules. One rule per line:
+ *
+ *   appid <app id> <property>...
+ *   title <text> <property>...
+ *
+ * appid rules match the app id exactly, title rules any title containing
+ * the text, which cannot hold spaces. Properties are:
+ *
+ *   tags <n>[,<n>...]     tags to put the window on
+ *   monitor <output>      output name, ignored while it is not connected
+ *   floating | tiled
+ *   fullscreen
+ *   geometry <w>x<h>[+<x>+<y>]  size, and position in the monitor's window
+ *                         area (centered without one), makes it float
+ *
+ * Every rule that matches applies, later lines win over earlier ones for
+ * the properties both set. Lines starting with # are comments. The file is
+ * read again together with the bindings; a file with errors is rejected as
+ * a whole and the rules in use are kept.
+ *
+ * Rules are looked up when the toplevel is created, before the initial
+ * configure, so fullscreen and geometry rules give the window its final size
+ * right away, and again when it maps to place it. App ids sit in a hash
+ * table and all title texts are compiled into one Aho-Corasick automaton,
+ * so a lookup costs one probe plus one step per byte of the title however
+ * many rules there are.
+ */
+
+struct rule {
+	char *match; // app id or title text
+	int next; // next rule with the same match, -1 for none
+	unsigned int hit; // stamp of the last lookup that matched it
+	unsigned int set; // Rule* properties it sets
+	uint32_t tags;
+	char *monitor;
+	int floating;
+	int fullscreen;
+	struct wlr_box geom; // x and y are -1 for centered
+};
+
+struct ruleset {
+	struct rule *rules;
+	size_t n;
+	int *appids; // open addressing, first rule of each app id or -1
+	size_t mask; // slot count - 1
+	// Title automaton, state 0 is the root. go[] is complete, every state
+	// has a transition for every byte
+	int (*go)[256];
+	int *fail;
+	int *out; // first rule whose text ends here, -1 for none
+	int *dict; // nearest state down the fail chain with an out, 0 for none
+	size_t nstates;
+};
+
+static struct ruleset rules;
+static unsigned int hit_stamp;
+
+static size_t str_hash(const char *s) {
+	// FNV-1a
+	size_t h = 14695981039346656037ull;
+
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 1099511628211ull;
+	return h;
+}
+
+static void ruleset_free(struct ruleset *rs) {
+	size_t i;
+
+	for (i = 0; i < rs->n; i++) {
+		free(rs->rules[i].match);
+		free(rs->rules[i].monitor);
+	}
+	free(rs->rules);
+	free(rs->appids);
+	free(rs->go);
+	free(rs->fail);
+	free(rs->out);
+	free(rs->dict);
+	*rs = (struct ruleset){0};
+}
+
+static void appid_add(struct ruleset *rs, int r) {
+	// Rules for the same app id are chained in file order
+	size_t i;
+	int *prev;
+
+	for (i = str_hash(rs->rules[r].match) & rs->mask; rs->appids[i] >= 0; i = (i + 1) & rs->mask) {
+		if (strcmp(rs->rules[rs->appids[i]].match, rs->rules[r].match))
+			continue;
+		for (prev = &rs->appids[i]; *prev >= 0; prev = &rs->rules[*prev].next);
+		*prev = r;
+		return;
+	}
+	rs->appids[i] = r;
+}
+
+static int state_new(struct ruleset *rs) {
+	size_t s = rs->nstates++;
+
+	rs->go = erealloc(rs->go, rs->nstates * sizeof(*rs->go));
+	rs->out = erealloc(rs->out, rs->nstates * sizeof(*rs->out));
+	memset(rs->go[s], -1, sizeof(rs->go[s]));
+	rs->out[s] = -1;
+	return s;
+}
+
+static void title_add(struct ruleset *rs, int r) {
+	const unsigned char *p;
+	int s = 0, t, *prev;
+
+	for (p = (const unsigned char *)rs->rules[r].match; *p; p++) {
+		// state_new() moves go[]
+		if ((t = rs->go[s][*p]) < 0) {
+			t = state_new(rs);
+			rs->go[s][*p] = t;
+		}
+		s = t;
+	}
+	for (prev = &rs->out[s]; *prev >= 0; prev = &rs->rules[*prev].next);
+	*prev = r;
+}
+
+static void title_compile(struct ruleset *rs) {
+	// Breadth first, so the fail state of every state is complete before
+	// the state itself is
+	int *queue = ecalloc(rs->nstates, sizeof(*queue));
+	size_t head = 0, tail = 0;
+	int c, s, t;
+
+	rs->fail = ecalloc(rs->nstates, sizeof(*rs->fail));
+	rs->dict = ecalloc(rs->nstates, sizeof(*rs->dict));
+	for (c = 0; c < 256; c++) {
+		if ((t = rs->go[0][c]) < 0)
+			rs->go[0][c] = 0;
+		else if (t > 0)
+			queue[tail++] = t;
+	}
+	while (head < tail) {
+		s = queue[head++];
+		for (c = 0; c < 256; c++) {
+			if ((t = rs->go[s][c]) < 0) {
+				rs->go[s][c] = rs->go[rs->fail[s]][c];
+				continue;
+			}
+			rs->fail[t] = rs->go[rs->fail[s]][c];
+			rs->dict[t] = rs->out[rs->fail[t]] >= 0 ? rs->fail[t] : rs->dict[rs->fail[t]];
+			queue[tail++] = t;
+		}
+	}
+	free(queue);
+}
+
+static void ruleset_compile(struct ruleset *rs, const int *is_title) {
+	size_t i;
+
+	for (rs->mask = 15; rs->mask + 1 < rs->n * 2; rs->mask = rs->mask * 2 + 1);
+	rs->appids = ecalloc(rs->mask + 1, sizeof(*rs->appids));
+	memset(rs->appids, -1, (rs->mask + 1) * sizeof(*rs->appids));
+	state_new(rs);
+	for (i = 0; i < rs->n; i++) {
+		rs->rules[i].next = -1;
+		if (is_title[i])
+			title_add(rs, i);
+		else
+			appid_add(rs, i);
+	}
+	title_compile(rs);
+}
+
+static const char *parse_property(char **save, struct rule *r) {
+	char *name = strtok_r(NULL, " \t", save), *arg = NULL, *tag, *end;
+	long n;
+	int len;
+
+	if (!strcmp(name, "floating") || !strcmp(name, "tiled")) {
+		r->set |= RuleFloating;
+		r->floating = !strcmp(name, "floating");
+		return NULL;
+	}
+	if (!strcmp(name, "fullscreen")) {
+		r->set |= RuleFullscreen;
+		r->fullscreen = 1;
+		return NULL;
+	}
+	if (!(arg = strtok_r(NULL, " \t", save)))
+		return "missing argument";
+
+	if (!strcmp(name, "tags")) {
+		r->set |= RuleTags;
+		r->tags = 0;
+		for (tag = arg; tag; tag = *end ? end + 1 : NULL) {
+			n = strtol(tag, &end, 10);
+			if ((*end && *end != ',') || n < 1 || n > TAGCOUNT)
+				return "not a tag number";
+			r->tags |= 1u << (n - 1);
+		}
+		return NULL;
+	}
+	if (!strcmp(name, "monitor")) {
+		r->set |= RuleMonitor;
+		free(r->monitor);
+		if (!(r->monitor = strdup(arg)))
+			die("strdup:");
+		return NULL;
+	}
+	if (!strcmp(name, "geometry")) {
+		r->geom.x = r->geom.y = -1;
+		if (sscanf(arg, "%dx%d%n", &r->geom.width, &r->geom.height, &len) < 2
+				|| (arg[len] && sscanf(arg + len, "+%d+%d", &r->geom.x, &r->geom.y) < 2)
+				|| r->geom.width <= 0 || r->geom.height <= 0)
+			return "expected <w>x<h>[+<x>+<y>]";
+		r->set |= RuleGeometry | RuleFloating;
+		r->floating = 1;
+		return NULL;
+	}
+	return "unknown property";
+}
+
+static const char *parse_line(char *line, struct ruleset *rs, int **is_title) {
+	// Returns an error message or NULL, blank lines and comments are fine
+	char *kind, *match, *save;
+	struct rule r = {0};
+	const char *err;
+
+	line += strspn(line, " \t");
+	if (!*line || *line == '#')
+		return NULL;
+	kind = strtok_r(line, " \t", &save);
+	if (!(match = strtok_r(NULL, " \t", &save)))
+		return "expected appid|title <match> <property>...";
+	if (strcmp(kind, "appid") && strcmp(kind, "title"))
+		return "expected appid or title";
+
+	while (*(save += strspn(save, " \t"))) {
+		if ((err = parse_property(&save, &r))) {
+			free(r.monitor);
+			return err;
+		}
+	}
+	if (!r.set)
+		return "rule sets nothing";
+	if (!(r.match = strdup(match)))
+		die("strdup:");
+
+	rs->rules = erealloc(rs->rules, (rs->n + 1) * sizeof(*rs->rules));
+	*is_title = erealloc(*is_title, (rs->n + 1) * sizeof(**is_title));
+	(*is_title)[rs->n] = !strcmp(kind, "title");
+	rs->rules[rs->n++] = r;
+	return NULL;
+}
+
+static char *rules_path(void) {
+	const char *env;
+	char *path;
+	size_t len;
+
+	if ((env = getenv("WM_RULES")))
+		return strdup(env);
+	if ((env = getenv("XDG_CONFIG_HOME")) && *env) {
+		len = strlen(env) + sizeof("/wm/rules");
+		path = ecalloc(1, len);
+		snprintf(path, len, "%s/wm/rules", env);
+		return path;
+	}
+	if ((env = getenv("HOME"))) {
+		len = strlen(env) + sizeof("/.config/wm/rules");
+		path = ecalloc(1, len);
+		snprintf(path, len, "%s/.config/wm/rules", env);
+		return path;
+	}
+	return NULL;
+}
+
+int rules_reload(void) {
+	struct ruleset rs = {0};
+	char *path = rules_path(), *line = NULL, *nl;
+	int *is_title = NULL, lineno = 0, bad = 0;
+	size_t size = 0;
+	const char *err;
+	FILE *f;
+
+	if (!path || !(f = fopen(path, "r"))) {
+		if (path && errno != ENOENT)
+			wlr_log_errno(WLR_ERROR, "rules: cannot read %s", path);
+		free(path);
+		ruleset_free(&rules);
+		return 0;
+	}
+	while (getline(&line, &size, f) >= 0) {
+		lineno++;
+		if ((nl = strchr(line, '\n')))
+			*nl = '\0';
+		if ((err = parse_line(line, &rs, &is_title))) {
+			wlr_log(WLR_ERROR, "rules: %s:%d: %s", path, lineno, err);
+			bad = 1;
+		}
+	}
+	free(line);
+	fclose(f);
+
+	if (bad) {
+		wlr_log(WLR_ERROR, "rules: keeping the rules in use");
+		ruleset_free(&rs);
+		free(is_title);
+		free(path);
+		return -1;
+	}
+	ruleset_compile(&rs, is_title);
+	wlr_log(WLR_INFO, "rules: %zu from %s, %zu title states", rs.n, path, rs.nstates);
+	free(is_title);
+	free(path);
+
+	ruleset_free(&rules);
+	rules = rs;
+	return 0;
+}
+
+void rules_finish(void) {
+	ruleset_free(&rules);
+}
+
+static void rules_hit(int r) {
+	for (; r >= 0; r = rules.rules[r].next)
+		rules.rules[r].hit = hit_stamp;
+}
+
+static struct Monitor *monitor_by_name(const char *name) {
+	struct Monitor *m;
+
+	wl_list_for_each(m, &server->monitors, link)
+		if (!strcmp(m->wlr_output->name, name))
+			return m;
+	return NULL;
+}
+
+int rules_match(struct Client *c, struct rule_match *match) {
+	// Merges every rule matching c into match, returns 0 if none did
+	const char *appid = client_get_appid(c), *title = client_get_title(c);
+	const unsigned char *p;
+	struct rule *r;
+	struct Monitor *m;
+	size_t i;
+	int s, t;
+
+	*match = (struct rule_match){0};
+	if (!rules.n)
+		return 0;
+
+	hit_stamp++;
+	for (i = appid ? str_hash(appid) & rules.mask : 0; appid && rules.appids[i] >= 0;
+			i = (i + 1) & rules.mask)
+		if (!strcmp(rules.rules[rules.appids[i]].match, appid)) {
+			rules_hit(rules.appids[i]);
+			break;
+		}
+	for (s = 0, p = (const unsigned char *)title; p && *p; p++) {
+		s = rules.go[s][*p];
+		for (t = rules.out[s] >= 0 ? s : rules.dict[s]; t; t = rules.dict[t])
+			rules_hit(rules.out[t]);
+	}
+
+	for (i = 0; i < rules.n; i++) {
+		r = &rules.rules[i];
+		if (r->hit != hit_stamp)
+			continue;
+		if (r->set & RuleMonitor && (m = monitor_by_name(r->monitor)))
+			match->mon = m;
+		if (r->set & RuleTags)
+			match->tags = r->tags;
+		if (r->set & RuleFloating)
+			match->floating = r->floating;
+		if (r->set & RuleFullscreen)
+			match->fullscreen = r->fullscreen;
+		if (r->set & RuleGeometry)
+			match->geom = r->geom;
+		match->set |= r->set;
+	}
+	if (match->set & RuleMonitor && !match->mon)
+		match->set &= ~RuleMonitor;
+	return match->set != 0;
+}
+
+void rules_place(struct Client *c, const struct rule_match *match, struct Monitor *m) {
+	// The geometry of a geometry rule on m, including the border
+	c->geom.width = match->geom.width + 2 * c->bw;
+	c->geom.height = match->geom.height + 2 * c->bw;
+	c->geom.x = m->w.x + (match->geom.x < 0 ? (m->w.width - c->geom.width) / 2 : match->geom.x);
+	c->geom.y = m->w.y + (match->geom.y < 0 ? (m->w.height - c->geom.height) / 2 : match->geom.y);
+}
+
+void rules_configure(struct Client *c) {
+	// Before the initial configure goes out: the size the rules give c, so
+	// it draws its first frame at its final size
+	struct rule_match match;
+	struct Monitor *m;
+
+	if (!rules_match(c, &match))
+		return;
+	m = match.mon ? match.mon : server->selmon;
+	if (match.set & RuleFullscreen && match.fullscreen) {
+		client_set_fullscreen(c, 1);
+		if (m)
+			client_set_size(c, m->m.width, m->m.height);
+	} else if (match.set & RuleGeometry && match.floating) {
+		client_set_size(c, match.geom.width, match.geom.height);
+	}
+}
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "wm.h"
+#include "wm-state.h"
+
+/*
+ * Shared memory copy of the status for readers that poll it, see
+ * wm-state.h for the layout and the reader side. Writers bump seq to an
+ * odd value, update the page and bump it again.
+ */
+
+static struct wm_state *page;
+static int page_fd = -1;
+
+void state_init(void) {
+	if ((page_fd = memfd_create("wm-state", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0
+			|| ftruncate(page_fd, sizeof(*page)) < 0) {
+		wlr_log_errno(WLR_ERROR, "state: cannot create the state page");
+		goto fail;
+	}
+	page = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, page_fd, 0);
+	if (page == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "state: cannot map the state page");
+		page = NULL;
+		goto fail;
+	}
+	page->magic = WM_STATE_MAGIC;
+	page->version = WM_STATE_VERSION;
+
+	// Readers get the same fd, make sure they can only ever map it read-only
+	// and cannot resize it under us. F_SEAL_FUTURE_WRITE needs Linux 5.1.
+	fcntl(page_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+	fcntl(page_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+	return;
+
+fail:
+	if (page_fd >= 0)
+		close(page_fd);
+	page_fd = -1;
+}
+
+void state_finish(void) {
+	if (page)
+		munmap(page, sizeof(*page));
+	if (page_fd >= 0)
+		close(page_fd);
+}
+
+int state_fd(void) {
+	return page_fd;
+}
+
+static void state_copy(char *dst, size_t size, const char *src) {
+	snprintf(dst, size, "%s", src ? src : "");
+}
+
+void state_publish(void) {
+	struct Monitor *m;
+	struct wm_state_monitor *sm;
+	const struct MonitorStatus *s;
+	uint32_t n = 0;
+
+	if (!page)
+		return;
+
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	wl_list_for_each(m, &server->monitors, link) {
+		if (n == WM_STATE_MONITORS)
+			break;
+		s = &m->status;
+		sm = &page->monitors[n++];
+		state_copy(sm->name, sizeof(sm->name), m->wlr_output->name);
+		sm->tags = s->tags;
+		sm->occupied = s->occ;
+		sm->urgent = s->urg;
+		sm->client_tags = s->sel;
+		sm->client = s->focus;
+		sm->fullscreen = s->fullscreen;
+		sm->floating = s->floating;
+		sm->selected = s->selmon;
+		state_copy(sm->title, sizeof(sm->title), s->focus ? s->title : NULL);
+		state_copy(sm->appid, sizeof(sm->appid), s->focus ? s->appid : NULL);
+	}
+	page->nmonitors = n;
+
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,213 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wm.h"
+
+/*
+ * Status lines for the bar reading our stdout and for IPC subscribers.
+ * printstatus() only asks for an update, the lines are written once per
+ * event loop iteration and only for the fields that changed since the
+ * last time.
+ */
+
+enum { StTitle, StAppid, StFullscreen, StFloating, StSelmon, StTags, StLayout, StFocus, NUM_ST };
+
+static const struct {
+	const char *name;
+	uint32_t event; // IPC subscription the line goes to
+	int bar; // also written to stdout
+} fields[] = {
+	[StTitle] = {"title", IpcTitle, 1},
+	[StAppid] = {"appid", IpcTitle, 1},
+	[StFullscreen] = {"fullscreen", IpcFocus, 1},
+	[StFloating] = {"floating", IpcFocus, 1},
+	[StSelmon] = {"selmon", IpcMonitor, 1},
+	[StTags] = {"tags", IpcTags, 1},
+	[StLayout] = {"layout", IpcLayout, 1},
+	[StFocus] = {"focus", IpcFocus, 0},
+};
+
+static const char broken[] = "broken";
+static struct wl_event_source *status_idle;
+static int monitors_changed; // the state page still lists a removed monitor
+
+static const char *line_printf(const char *fmt, ...) {
+	// Formats into a buffer that grows to fit, so long titles keep their
+	// end and the newline; valid until the next call
+	static char *line;
+	static size_t cap;
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, cap, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return "\n";
+	if ((size_t)len >= cap) {
+		cap = len + 1;
+		line = erealloc(line, cap);
+		va_start(ap, fmt);
+		vsnprintf(line, cap, fmt, ap);
+		va_end(ap);
+	}
+	return line;
+}
+
+static const char *status_format(struct Monitor *m, int field) {
+	const struct MonitorStatus *s = &m->status;
+	const char *name = m->wlr_output->name;
+	int flag;
+
+	switch (field) {
+	case StTitle:
+	case StAppid:
+		return line_printf("%s %s %s\n", name, fields[field].name,
+				field == StTitle ? s->title : s->appid);
+	case StTags:
+		return line_printf("%s tags %u %u %u %u\n", name, s->occ, s->tags, s->sel, s->urg);
+	case StLayout:
+		return line_printf("%s layout []=\n", name);
+	case StFocus:
+		// Identifies the client across title changes, empty for none
+		if (s->focus)
+			return line_printf("%s focus %u\n", name, s->focus);
+		return line_printf("%s focus \n", name);
+	}
+
+	// -1 stands for "no client", which the bar gets as an empty field
+	flag = field == StFullscreen ? s->fullscreen : field == StFloating ? s->floating : s->selmon;
+	if (flag < 0)
+		return line_printf("%s %s \n", name, fields[field].name);
+	return line_printf("%s %s %u\n", name, fields[field].name, flag);
+}
+
+static int status_str(char **cached, const char *value) {
+	if (*cached && !strcmp(*cached, value))
+		return 0;
+	free(*cached);
+	if (!(*cached = strdup(value)))
+		die("strdup:");
+	return 1;
+}
+
+static uint32_t status_update(struct Monitor *m) {
+	// Returns the fields that changed as a bit mask
+	struct MonitorStatus *s = &m->status;
+	struct Client *c = monitor_get_top_client(m);
+	const char *appid = "", *title = "";
+	uint32_t occ = 0, urg = 0, tags = m->tagset[m->seltags], sel = c ? c->tags : 0;
+	uint32_t changed = 0;
+	int i;
+
+	for (i = 0; i < TAGCOUNT; i++) {
+		if (!wl_list_empty(&m->tag_clients[i]))
+			occ |= 1u << i;
+		if (m->tag_urgent[i])
+			urg |= 1u << i;
+	}
+	if (c) {
+		title = (title = client_get_title(c)) ? title : broken;
+		appid = (appid = client_get_appid(c)) ? appid : broken;
+	}
+
+#define STATUS_SET(field, member, value) \
+	if (!s->valid || s->member != (value)) { s->member = (value); changed |= 1u << (field); }
+	if (status_str(&s->title, title))
+		changed |= 1u << StTitle;
+	if (status_str(&s->appid, appid))
+		changed |= 1u << StAppid;
+	STATUS_SET(StFullscreen, fullscreen, c ? c->is_fullscreen : -1);
+	STATUS_SET(StFloating, floating, c ? c->is_floating : -1);
+	STATUS_SET(StSelmon, selmon, m == server->selmon);
+	STATUS_SET(StFocus, focus, c ? c->seq : 0);
+	if (!s->valid || s->occ != occ || s->tags != tags || s->sel != sel || s->urg != urg) {
+		s->occ = occ;
+		s->tags = tags;
+		s->sel = sel;
+		s->urg = urg;
+		changed |= 1u << StTags;
+	}
+	if (!s->valid)
+		changed |= 1u << StLayout;
+#undef STATUS_SET
+
+	s->valid = 1;
+	return changed;
+}
+
+static void status_flush(void *data) {
+	struct Monitor *m;
+	const char *line;
+	uint32_t changed;
+	int i, bar = 0, publish = monitors_changed;
+	uint64_t start = prof_begin();
+
+	status_idle = NULL;
+	wl_list_for_each(m, &server->monitors, link) {
+		changed = status_update(m);
+		publish |= changed != 0;
+		for (i = 0; i < NUM_ST; i++) {
+			if (!(changed & 1u << i))
+				continue;
+			line = status_format(m, i);
+			if (fields[i].bar) {
+				fputs(line, stdout);
+				bar = 1;
+			}
+			ipc_broadcast(fields[i].event, line);
+		}
+	}
+	if (bar)
+		fflush(stdout);
+	if (publish)
+		state_publish();
+	monitors_changed = 0;
+	ipc_flush();
+	prof_end(ProfPrintstatus, start);
+}
+
+void printstatus(void) {
+	if (!status_idle)
+		status_idle = wl_event_loop_add_idle(
+				wl_display_get_event_loop(server->display), status_flush, NULL);
+}
+
+void status_snapshot(uint32_t events, void (*emit)(const char *line, void *data), void *data) {
+	// Everything the bar knows, for an IPC client that just subscribed
+	struct Monitor *m;
+	const char *line;
+	int i;
+
+	wl_list_for_each(m, &server->monitors, link) {
+		if (!m->status.valid)
+			continue;
+		for (i = 0; i < NUM_ST; i++) {
+			if (!(events & fields[i].event))
+				continue;
+			line = status_format(m, i);
+			emit(line, data);
+		}
+	}
+}
+
+void status_resend(void) {
+	// The bar was started again on a fresh pipe, it only knows what the
+	// next flush writes, so make that everything
+	struct Monitor *m;
+
+	wl_list_for_each(m, &server->monitors, link) {
+		free(m->status.title);
+		free(m->status.appid);
+		m->status = (struct MonitorStatus){0};
+	}
+	printstatus();
+}
+
+void status_forget(struct Monitor *m) {
+	free(m->status.title);
+	free(m->status.appid);
+	m->status = (struct MonitorStatus){0};
+	monitors_changed = 1;
+}
@@ -1,124 +1,263 @@
+#define _GNU_SOURCE
 #include "wm.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xdg_activation_v1.h>
+#include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
 
+/*
+ * Every process the compositor starts goes through spawn(). posix_spawn()
+ * lets glibc use clone(CLONE_VM|CLONE_VFORK), so starting a process does
+ * not copy our page tables (large with many clients and GPU mappings) the
+ * way fork() does; the main thread is only held up until the exec.
+ *
+ * Children are watched with a pidfd on the event loop, or from SIGCHLD on
+ * kernels without pidfds, and reaped one by one, the struct process lives
+ * until its child exited and its activation token is gone.
+ *
+ * Processes the user started remember the monitor and tags they were started
+ * on, applyrules() finds them by the pid of the new window's client, or
+ * urgent() by the activation token, and puts the window there right away.
+ */
+
+extern char **environ;
+
+static const char token_var[] = "XDG_ACTIVATION_TOKEN=";
+
 static void process_destroy(struct process *process) {
 	if (!process) return;
 
-	wl_list_remove(&process->token_destroy.link);
+	if (process->token) {
+		wl_list_remove(&process->token_destroy.link);
+		wlr_xdg_activation_token_v1_destroy(process->token);
+	}
+	if (process->exit_source)
+		wl_event_source_remove(process->exit_source);
+	if (process->pidfd >= 0)
+		close(process->pidfd);
 	wl_list_remove(&process->link);
-	wlr_xdg_activation_token_v1_destroy(process->token);
+	free(process->cmd);
 	free(process);
-	wlr_log(WLR_INFO, "process finished!\n");
 }
 
 static void token_destroy(struct wl_listener *listener, void *data) {
+	// Used or timed out, the process itself may well still run
 	struct process *process = wl_container_of(listener, process, token_destroy);
+	wl_list_remove(&process->token_destroy.link);
 	process->token = NULL;
-	process_destroy(process);
+	if (!process->pid)
+		process_destroy(process);
+}
+
+static int process_reap(struct process *process) {
+	// Returns 1 once the child is gone
+	int status;
+	pid_t ret;
+
+	while ((ret = waitpid(process->pid, &status, WNOHANG)) < 0 && errno == EINTR);
+	if (ret == 0)
+		return 0;
+	if (ret < 0)
+		status = -1;
+	else if (WIFEXITED(status) && WEXITSTATUS(status))
+		wlr_log(WLR_INFO, "\"%s\" (%d) exited with %d", process->cmd, process->pid, WEXITSTATUS(status));
+	else if (WIFSIGNALED(status))
+		wlr_log(WLR_INFO, "\"%s\" (%d) killed by signal %d", process->cmd, process->pid, WTERMSIG(status));
+
+	if (process->exited)
+		process->exited(process, status, process->data);
+	if (!process->token) {
+		process_destroy(process);
+		return 1;
+	}
+	// Its token may still be used by a program it started (a launcher
+	// exits before the program it ran maps), token_destroy() frees it
+	if (process->exit_source)
+		wl_event_source_remove(process->exit_source);
+	if (process->pidfd >= 0)
+		close(process->pidfd);
+	process->exit_source = NULL;
+	process->pidfd = -1;
+	process->pid = 0;
+	process->exited = NULL;
+	return 1;
+}
+
+static int process_exited(int fd, uint32_t mask, void *data) {
+	process_reap(data);
+	return 0;
 }
 
-int run_daemon(const char *cmd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat) {
+void process_check(void) {
+	// From SIGCHLD, for the children we have no pidfd of
+	struct process *process, *tmp;
+
+	wl_list_for_each_safe(process, tmp, &server->processes, link)
+		if (process->pid && process->pidfd < 0)
+			process_reap(process);
+}
+
+void process_place_here(struct process *process) {
+	// Started by the user, its window goes where they were looking
+	if (!process || !(process->mon = server->selmon))
+		return;
+	process->tags = process->mon->tagset[process->mon->seltags];
+}
+
+static pid_t parent_pid(pid_t pid) {
+	// From /proc/<pid>/stat, whose second field may hold spaces and parens
+	char path[64], buf[512], *p;
+	pid_t ppid = 0;
+	FILE *f;
+	size_t n;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if (!(f = fopen(path, "re")))
+		return 0;
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	if ((p = strrchr(buf, ')')))
+		sscanf(p + 1, " %*c %d", &ppid);
+	return ppid;
+}
+
+struct process *process_for_client(struct Client *c) {
+	// The process we started that c belongs to, the client itself or one
+	// of its few nearest ancestors: sh -c does not always exec, and
+	// launchers start programs from children of their own
+	struct process *process;
 	pid_t pid;
-	pid_t child;
+	int depth;
+
+	wl_client_get_credentials(c->surface->client->client, &pid, NULL, NULL);
+	for (depth = 0; pid > 1 && depth < PROCESS_ANCESTORS; depth++) {
+		wl_list_for_each(process, &server->processes, link)
+			if (process->pid == pid)
+				return process;
+		pid = parent_pid(pid);
+	}
+	return NULL;
+}
+
+struct process *process_for_token(struct wlr_xdg_activation_token_v1 *token) {
+	struct process *process;
+
+	wl_list_for_each(process, &server->processes, link)
+		if (process->token == token)
+			return process;
+	return NULL;
+}
+
+static char **spawn_env(const char *token) {
+	// Our environment with the child's activation token in it, the strings
+	// are shared with environ apart from the last one
+	size_t n = 0, len = sizeof(token_var) + strlen(token);
+	char **env, **e;
+
+	for (e = environ; *e; e++)
+		n++;
+	env = ecalloc(n + 2, sizeof(*env));
+	for (n = 0, e = environ; *e; e++)
+		if (strncmp(*e, token_var, sizeof(token_var) - 1))
+			env[n++] = *e;
+	env[n] = ecalloc(1, len);
+	snprintf(env[n], len, "%s%s", token_var, token);
+	return env;
+}
+
+struct process *spawn(const char *cmd, int stdin_fd, int stdout_fd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat) {
+	char *argv[] = {"sh", "-c", (char *)cmd, NULL};
 	struct wlr_xdg_activation_token_v1 *token;
 	struct process *process;
-	ssize_t s = 0;
-	int fd[2];
-	if (pipe(fd) == -1) return -1;
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t set;
+	char **env;
+	size_t n;
+	pid_t pid;
+	int err;
 
 	token = wlr_xdg_activation_token_v1_create(activation);
 	token->seat = seat;
-	process = malloc(sizeof(struct process));
+	process = ecalloc(1, sizeof(*process));
+	process->pidfd = -1;
+	if (!(process->cmd = strdup(cmd)))
+		die("strdup:");
 	process->token = token;
 	process->token_destroy.notify = token_destroy;
 	wl_list_init(&process->link);
 	wl_signal_add(&token->events.destroy, &process->token_destroy);
 	wl_list_insert(processes, &process->link);
 
-	if ((pid = fork()) == 0) {
-		sigset_t set;
-		setsid();
-		sigemptyset(&set);
-		sigprocmask(SIG_SETMASK, &set, NULL);
-		signal(SIGPIPE, SIG_DFL);
-		close(fd[0]);
+	posix_spawn_file_actions_init(&actions);
+	if (stdin_fd >= 0 && stdin_fd != STDIN_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+	if (stdout_fd >= 0 && stdout_fd != STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
 
-		if ((child = fork()) == 0) {
-			const char *xdg_token_name = wlr_xdg_activation_token_v1_get_name(token);
-			setenv("XDG_ACTIVATION_TOKEN", xdg_token_name, 1);
-			close(fd[1]);
-			execlp("sh", "sh", "-c", cmd, NULL);
-			_exit(1);
-		}
-
-		s = 0;
-		while ((size_t)s < sizeof(pid_t)) {
-			s += write(fd[1], ((uint8_t *)&child) + s, sizeof(pid_t) - s);
-		}
-		close(fd[1]);
-		_exit(0);
-	} else if (pid < 0) {
-		close(fd[0]);
-		close(fd[1]);
-		return -1;
-	}
+	// Signals we read from signalfds are blocked, children start with a
+	// clean mask, in a session of their own
+	posix_spawnattr_init(&attr);
+	sigemptyset(&set);
+	posix_spawnattr_setsigmask(&attr, &set);
+	sigaddset(&set, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &set);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF
+			| POSIX_SPAWN_SETSID);
 
-	close(fd[1]);
-	s = 0;
-	while ((size_t)s < sizeof(pid_t)) {
-		s += read(fd[0], ((uint8_t *)&child) + s, sizeof(pid_t) - s);
-	}
-	close(fd[0]);
-
-	waitpid(pid, NULL, 0);
-	
-	wlr_log(WLR_INFO, "Created process \"%s\"", cmd);
+	env = spawn_env(wlr_xdg_activation_token_v1_get_name(token));
+	err = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, env);
+	for (n = 0; env[n]; n++);
+	free(env[n - 1]);
+	free(env);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
 
-	return 0;
+	if (err) {
+		errno = err;
+		wlr_log_errno(WLR_ERROR, "Cannot spawn \"%s\"", cmd);
+		process_destroy(process);
+		return NULL;
+	}
+	process->pid = pid;
+	// Not reaped yet, so the pid cannot have been reused
+	if ((process->pidfd = syscall(SYS_pidfd_open, pid, 0)) >= 0) {
+		fcntl(process->pidfd, F_SETFD, FD_CLOEXEC);
+		process->exit_source = wl_event_loop_add_fd(wl_display_get_event_loop(server->display),
+				process->pidfd, WL_EVENT_READABLE, process_exited, process);
+	}
+	wlr_log(WLR_INFO, "Spawned \"%s\" as %d", cmd, pid);
+	return process;
 }
 
-int run_child(const char *cmd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat) {
-	pid_t child;
-	struct wlr_xdg_activation_token_v1 *token;
+struct process *run_child(const char *cmd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat) {
+	// The child reads our stdout, the status lines
 	struct process *process;
 	int fd[2];
-	if (pipe(fd) == -1) return -1;
 
-	token = wlr_xdg_activation_token_v1_create(activation);
-	token->seat = seat;
-	process = malloc(sizeof(struct process));
-	process->token = token;
-	process->token_destroy.notify = token_destroy;
-	wl_list_init(&process->link);
-	wl_signal_add(&token->events.destroy, &process->token_destroy);
-	wl_list_insert(processes, &process->link);
+	if (pipe(fd) == -1)
+		return NULL;
+	fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fd[1], F_SETFD, FD_CLOEXEC);
 
-	if ((child = fork()) == 0) {
-		const char *xdg_token_name = wlr_xdg_activation_token_v1_get_name(token);
-		dup2(fd[0], STDIN_FILENO);
-		close(fd[0]);
-		setenv("XDG_ACTIVATION_TOKEN", xdg_token_name, 1);
-		close(fd[1]);
-		execlp("sh", "sh", "-c", cmd, NULL);
-		wlr_log(WLR_INFO, "I AM THE CHILD %s", cmd);
-		_exit(0);
-	} else if (child < 0) {
+	if (!(process = spawn(cmd, fd[0], -1, processes, activation, seat))) {
 		close(fd[0]);
 		close(fd[1]);
-		return -1;
+		return NULL;
 	}
 
 	dup2(fd[1], STDOUT_FILENO);
+	close(fd[0]);
 	close(fd[1]);
-	close(fd[2]);
-	
-	wlr_log(WLR_INFO, "Created child process \"%s\"", cmd);
-
-	return 0;
+	return process;
 }
@@ -0,0 +1,55 @@
+#ifndef WM_STATE_H
+#define WM_STATE_H
+
+/*
+ * Layout of the shared state page. Send "state" over the WM_IPC socket to
+ * get a read-only memfd with this structure in it, then mmap it and read it
+ * with wm_state_read() as often as you like. The compositor rewrites the
+ * page whenever the status of a monitor changes.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define WM_STATE_MAGIC 0x776d7374 // "wmst"
+#define WM_STATE_VERSION 1
+#define WM_STATE_MONITORS 8
+#define WM_STATE_NAME 32
+#define WM_STATE_TITLE 256
+#define WM_STATE_APPID 128
+
+struct wm_state_monitor {
+	char name[WM_STATE_NAME]; // output name
+	uint32_t tags; // shown tagset
+	uint32_t occupied; // tags with clients
+	uint32_t urgent; // tags with urgent clients
+	uint32_t client_tags; // tags of the focused client, 0 for none
+	uint32_t client; // focused client id (map sequence number), 0 for none
+	int32_t fullscreen; // of the focused client, -1 for none
+	int32_t floating; // of the focused client, -1 for none
+	int32_t selected; // this is the selected monitor
+	char title[WM_STATE_TITLE]; // focused client, empty for none
+	char appid[WM_STATE_APPID];
+};
+
+struct wm_state {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq; // odd while the compositor is writing
+	uint32_t nmonitors;
+	struct wm_state_monitor monitors[WM_STATE_MONITORS];
+};
+
+// Copies a consistent snapshot of page into out
+static inline void wm_state_read(const struct wm_state *page, struct wm_state *out) {
+	uint32_t seq;
+
+	do {
+		while ((seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE)) & 1)
+			;
+		memcpy(out, page, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq);
+}
+
+#endif // WM_STATE_H
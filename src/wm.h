@@ -6,6 +6,7 @@
 #include <limits.h>
 #include <linux/input-event-codes.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -32,6 +33,7 @@
 #include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/types/wlr_primary_selection_v1.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/types/wlr_server_decoration.h>
@@ -47,6 +49,7 @@
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/box.h>
 #include <wlr/util/log.h>
+#include <wlr/version.h>
 #include <xkbcommon/xkbcommon.h>
 
 #define MAX(A, B)               ((A) > (B) ? (A) : (B))
@@ -54,11 +57,54 @@
 #define VISIBLEON(C, M)         ((M) && (C)->mon == (M) && ((C)->tags & (M)->tagset[(M)->seltags]))
 #define LENGTH(X)               (sizeof X / sizeof X[0])
 #define END(A)                  ((A) + LENGTH(A))
-#define TAGMASK                 ((1u << 9) - 1)
+#define TAGCOUNT                9
+#define TAGMASK                 ((1u << TAGCOUNT) - 1)
 #define LISTEN(E, L, H)         wl_signal_add((E), ((L)->notify = (H), (L)))
+// xdg-shell v6 brought the suspended toplevel state, wlroots has it from 0.18
+#if WLR_VERSION_MAJOR > 0 || WLR_VERSION_MINOR >= 18
+#define XDG_SHELL_VERSION 6
+#else
+#define XDG_SHELL_VERSION 4
+#endif
 #define IDLE_NOTIFY_ACTIVITY wlr_idle_notify_activity(server->idle, server->seat), wlr_idle_notifier_v1_notify_activity(server->idle_notifier, server->seat)
 // WLR_MODIFIER_LOGO
 #define MODKEY WLR_MODIFIER_ALT
+// How long a relayout waits for clients to draw at their new size (ms)
+#define TXN_TIMEOUT_MS 200
+// How long before the predicted vblank outputs start rendering (ms), 0 renders
+// as soon as the output asks for a frame, MAX_RENDER_TIME_AUTO measures it
+#define MAX_RENDER_TIME_AUTO -1
+#define MAX_RENDER_TIME MAX_RENDER_TIME_AUTO
+// Latency histograms: 100us buckets up to 50ms, then one overflow bucket
+#define LATENCY_BUCKET_NS 100000
+#define LATENCY_BUCKETS 500
+// Inputs not answered within this are dropped by the latency tracer
+#define LATENCY_STALE_NS 100000000ull
+// Pointer motion only moves the cursor, the hit test and focus run once per
+// event loop iteration, 0 runs them for every motion event
+#define MOTION_COALESCE 1
+// Which client gets keyboard focus from the pointer, see the Focus* values
+#define FOCUS_POLICY FocusFollowMouse
+#define FOCUS_DELAY_MS 150
+// Compile the default keymap at startup instead of with the first keyboard
+#define KEYMAP_PRECOMPILE 1
+// Keep instances of the programs in pool.c started and hidden, the pool
+// binding shows one; 0 makes it start the program like spawn
+#define WARM_POOL 1
+// How far up from a new window's client to look for the process we started
+#define PROCESS_ANCESTORS 4
+
+enum {
+	LyrBg,
+	LyrBottom,
+	LyrTile,
+	LyrFloat,
+	LyrFS,
+	LyrTop,
+	LyrOverlay,
+	LyrBlock,
+	NUM_LAYERS 
+}; // scene layers
 
 struct Client {
 	unsigned int type; // Never X11
@@ -67,8 +113,12 @@ struct Client {
 	struct wlr_scene_tree *scene;
 	struct wlr_scene_rect *border[4]; // top, bottom, left, right
 	struct wlr_scene_tree *scene_surface;
+	struct wlr_scene_tree *saved; // last buffers, shown while a resize is in flight
+	struct wl_list txn_link; // Monitor::txn_clients, empty when not waiting
+	int shown; // geometry has been applied to the scene since map
 	struct wl_list link;
 	struct wl_list flink;
+	struct wl_list tlink[TAGCOUNT]; // Monitor::tag_clients, only while mon is set
 	struct wlr_xdg_surface *surface;
 	struct wl_listener commit;
 	struct wl_listener map;
@@ -80,10 +130,24 @@ struct Client {
 	struct wlr_box prev; // layout-relative, includes border
 	unsigned int bw;
 	uint32_t tags;
+	uint32_t seq; // map order, server->clients is sorted by it (newest first)
+	unsigned int visible_gen; // dedup stamp for monitor_update_visible()
 	int is_floating;
 	int is_urgent;
 	int is_fullscreen;
 	uint32_t resize; // configure serial of a pending size
+	struct procstate *proc;
+	int pooled; // mapped and kept without a monitor by pool.c
+	int suspended; // not on a visible tag, see client_set_suspended()
+};
+
+struct rule_match {
+	unsigned int set; // Rule* properties the matching rules set
+	uint32_t tags;
+	struct Monitor *mon;
+	int floating;
+	int fullscreen;
+	struct wlr_box geom; // client size, x and y in the window area or -1
 };
 
 struct Keyboard {
@@ -118,12 +182,40 @@ struct LayerSurface {
 	struct wl_listener surface_commit;
 };
 
+enum { LatCommit, LatPresent, NUM_LAT_STAGES }; // latency tracer stages
+
+enum { // IPC subscriptions
+	IpcFocus = 1 << 0,
+	IpcTags = 1 << 1,
+	IpcTitle = 1 << 2,
+	IpcMonitor = 1 << 3,
+	IpcLayout = 1 << 4,
+};
+
+enum { ProfArrange, ProfXytonode, ProfPrintstatus, ProfRendermon, NUM_PROF }; // prof.c timers
+
+struct latency_hist {
+	unsigned long count;
+	uint64_t max; // ns
+	unsigned int bucket[LATENCY_BUCKETS + 1];
+};
+
+struct MonitorStatus { // what the bar was last told, see status.c
+	int valid;
+	char *title, *appid;
+	int fullscreen, floating, selmon;
+	uint32_t occ, tags, sel, urg;
+	uint32_t focus; // Client::seq of the top client, 0 for none
+};
+
 struct Monitor {
 	struct wl_list link;
 	struct wlr_output *wlr_output;
 	struct wlr_scene_output *scene_output;
 	struct wlr_scene_rect *fullscreen_bg; // See createmon() for info
 	struct wl_listener frame;
+	struct wl_listener present;
+	struct wl_listener commit;
 	struct wl_listener destroy;
 	struct wl_listener destroy_lock_surface;
 	struct wlr_session_lock_surface_v1 *lock_surface;
@@ -135,6 +227,36 @@ struct Monitor {
 	uint32_t tagset[2];
 	double mfact;
 	int nmaster;
+	int arrange_pending; // flushed by monitor_arrange_flush()
+	struct wl_list tag_clients[TAGCOUNT]; // Client::tlink
+	unsigned int tag_urgent[TAGCOUNT]; // urgent clients in each bucket
+	// Client scene parents for LyrTile, LyrFloat and LyrFS: one tree per tag,
+	// plus one (index TAGCOUNT) for clients with several tags
+	struct wlr_scene_tree *tag_trees[LyrFS - LyrTile + 1][TAGCOUNT + 1];
+	struct Client **visible; // VISIBLEON clients in server->clients order
+	size_t nvisible, visible_cap;
+	uint32_t visible_tags; // tagset the visible cache was built for
+	int visible_dirty; // a client joined or left one of the tag buckets
+	unsigned int pending_resizes; // tiled clients here with Client::resize set
+	struct wl_list txn_clients; // Client::txn_link, geometry not applied yet
+	struct wl_event_source *txn_timer;
+	int txn_armed;
+	int txn_batch; // set while arranging, every tiled client waits
+	int max_render_time; // ms, see MAX_RENDER_TIME
+	struct wl_event_source *render_timer;
+	struct timespec last_present;
+	int refresh; // ns between vblanks as reported by the last present, 0 unknown
+	long render_cost; // ns, moving average of wlr_scene_output_commit()
+	// LyrBg to LyrFloat content of this monitor, hidden while a fullscreen
+	// client covers it so the scene can scan the client out directly
+	struct wlr_scene_tree *layer_trees[LyrFloat + 1];
+	int fullscreen;
+	int scanout; // the last frame was the fullscreen client's own buffer
+	unsigned long scanout_frames, composite_frames;
+	struct latency_hist latency[NUM_LAT_STAGES];
+	uint64_t latency_input; // ns, input answered by a commit not presented yet
+	int latency_rendered; // that commit made it into an output commit
+	struct MonitorStatus status;
 };
 
 struct SessionLock {
@@ -153,26 +275,50 @@ enum {
 	CurResize
 }; // cursor
 
+enum {
+	FocusFollowMouse, // focus the client the pointer enters
+	FocusDelayed, // ... once the pointer rested in it for FOCUS_DELAY_MS
+	FocusClick, // focus and raise the client clicked on
+}; // focus policy
+
+enum {
+	RuleTags = 1 << 0,
+	RuleMonitor = 1 << 1,
+	RuleFloating = 1 << 2,
+	RuleFullscreen = 1 << 3,
+	RuleGeometry = 1 << 4,
+}; // properties a window rule sets, see rules.c
+
 enum { 
 	XDGShell, 
 	LayerShell 
 }; // client types
 
-enum {
-	LyrBg,
-	LyrBottom,
-	LyrTile,
-	LyrFloat,
-	LyrFS,
-	LyrTop,
-	LyrOverlay,
-	LyrBlock,
-	NUM_LAYERS 
-}; // scene layers
+struct procstate {
+	pid_t pid;
+	int refs;
+	int pidfd;
+	struct wl_event_source *source;
+	int child; // waitid() can report stops and continues
+	int stopped;
+	int exited;
+	struct wl_list link;
+};
 
 struct process {
+	pid_t pid; // 0 until spawned and once reaped
+	char *cmd;
+	int pidfd;
+	struct wl_event_source *exit_source;
+	// Called once the child is reaped, status as from waitpid() or -1
+	void (*exited)(struct process *process, int status, void *data);
+	void *data;
 	struct wlr_xdg_activation_token_v1 *token;
 	struct wl_listener token_destroy;
+	// Where it was started from, its first window is placed there; mon
+	// is NULL for anywhere
+	struct Monitor *mon;
+	uint32_t tags;
 	struct wl_list link;
 };
 
@@ -187,6 +333,7 @@ struct server {
 	struct wlr_box sgeom;
 	struct wlr_seat *seat;
 	struct Monitor *selmon;
+	struct wl_event_source *arrange_idle;
 	
 	struct wlr_idle *idle;
 	struct wlr_idle_notifier_v1 *idle_notifier;
@@ -208,9 +355,12 @@ struct server {
 
 	struct wlr_cursor *cursor;
 	struct wlr_xcursor_manager *cursor_mgr;
+	struct wlr_relative_pointer_manager_v1 *relative_pointer_mgr;
 	unsigned int cursor_mode;
 	int grabcx, grabcy;
 	struct Client *grabc;
+	struct Client *pointerc; // client the pointer last entered
+	struct wl_event_source *focus_timer;
 	const char *cursor_image;
 
 	void *exclusive_focus;
@@ -244,16 +394,41 @@ struct server {
 	struct wl_listener new_virtual_keyboard;
 
 	struct wl_list processes;
+	struct wl_list procstates;
 	struct wl_list monitors;
 	struct wl_list clients;
 	struct wl_list focus_stack;
+	uint32_t client_seq;
+	unsigned int visible_gen;
 };
 
 extern struct server *server;
 
-int run_daemon(const char *cmd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat);
+struct process *spawn(const char *cmd, int stdin_fd, int stdout_fd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat);
+
+void process_check(void);
+
+void process_place_here(struct process *process);
+
+struct process *process_for_client(struct Client *c);
+
+struct process *process_for_token(struct wlr_xdg_activation_token_v1 *token);
+
+void autostart_init(const char *display);
 
-int run_child(const char *cmd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat);
+void autostart_finish(void);
+
+void pool_init(void);
+
+void pool_finish(void);
+
+int pool_adopt(struct Client *c);
+
+void pool_forget(struct Client *c);
+
+void pool_take(const char *name);
+
+struct process *run_child(const char *cmd, struct wl_list *processes, struct wlr_xdg_activation_v1 *activation, struct wlr_seat *seat);
 
 struct Monitor *xytomon(struct wlr_output_layout *output_layout, double x, double y);
 
@@ -261,6 +436,40 @@ void die(const char *fmt, ...);
 
 void *ecalloc(size_t nmemb, size_t size);
 
+void *erealloc(void *p, size_t size);
+
+void procstate_init(void);
+
+void procstate_finish(void);
+
+struct procstate *procstate_get(pid_t pid);
+
+void procstate_put(struct procstate *p);
+
+void prof_init(void);
+
+uint64_t prof_begin(void);
+
+void prof_end(int id, uint64_t start);
+
+void prof_dump(FILE *f);
+
+void latency_init(void);
+
+void latency_finish(void);
+
+void latency_dump(FILE *f);
+
+void latency_input(uint32_t time_msec, struct wlr_surface *surface);
+
+void latency_forget(struct wlr_surface *surface);
+
+void latency_commit(struct Client *c);
+
+void latency_output_commit(struct Monitor *m);
+
+void latency_present(struct Monitor *m, const struct timespec *when);
+
 void setup(void);
 
 void run(void);
@@ -276,6 +485,8 @@ void buttonpress(struct wl_listener *listener, void *data);
 void cursorframe(struct wl_listener *listener, void *data);
 
 void motionnotify(uint32_t time);
+void motion_queue(uint32_t time);
+void motion_flush(void);
 
 void motionrelative(struct wl_listener *listener, void *data);
 
@@ -301,12 +512,19 @@ struct Client *monitor_get_top_client(struct Monitor *m);
 
 void client_notify_enter(struct wlr_surface *s, struct wlr_keyboard *kb);
 
+void hittest_invalidate(void);
 struct wlr_scene_node *xytonode(double x, double y, struct wlr_surface **psurface, struct Client **pc, struct LayerSurface **pl, double *nx, double *ny);
 
 void pointerfocus(struct Client *c, struct wlr_surface *surface, double sx, double sy, uint32_t time);
 
 void monitor_set(struct Client *c, struct Monitor *m, uint32_t newtags);
 
+void monitor_retag_client(struct Client *c, uint32_t tags);
+
+void client_reparent(struct Client *c);
+
+struct Client **monitor_visible_clients(struct Monitor *m, size_t *n);
+
 void applybounds(struct Client *c, struct wlr_box *bbox);
 
 void applyrules(struct Client *c);
@@ -319,8 +537,22 @@ void monitor_arrange_layers(struct Monitor *m);
 
 void monitor_close(struct Monitor *m);
 
+struct wlr_scene_tree *monitor_layer_tree(struct Monitor *m, int layer);
+
+void monitor_update_fullscreen(struct Monitor *m);
+
+int monitor_txn_defer(struct Monitor *m, struct Client *c);
+
+void monitor_txn_check(struct Monitor *m);
+
+void monitor_txn_drop(struct Client *c);
+
 void createkeyboard(struct wlr_keyboard *keyboard);
 
+void keymap_init(void);
+
+void keymap_finish(void);
+
 void createpointer(struct wlr_pointer *pointer);
 
 struct Monitor *monitor_get_by_direction(enum wlr_direction dir);
@@ -333,6 +565,66 @@ void outputmgrapplyortest(struct wlr_output_configuration_v1 *config, int test);
 
 void printstatus(void);
 
+void status_forget(struct Monitor *m);
+
+void status_resend(void);
+
+void status_snapshot(uint32_t events, void (*emit)(const char *line, void *data), void *data);
+
+void state_init(void);
+
+void state_finish(void);
+
+int state_fd(void);
+
+void state_publish(void);
+
+void ipc_init(const char *display);
+
+void ipc_finish(void);
+
+void ipc_broadcast(uint32_t event, const char *line);
+
+void ipc_flush(void);
+
+void view(uint32_t ui);
+
+void tag(uint32_t ui);
+
+void incnmaster(int i);
+
+void togglefullscreen(void);
+
+void monitor_focus(int dir);
+
+void monitor_tag(int dir);
+
+void focus_next(void);
+
+void focus_prev(void);
+
+void kill_focused_client(void);
+
+void bindings_init(void);
+
+void bindings_finish(void);
+
+int bindings_reload(void);
+
+int bindings_key(uint32_t mods, xkb_keysym_t sym);
+
+int bindings_button(uint32_t mods, uint32_t button);
+
+int rules_reload(void);
+
+void rules_finish(void);
+
+int rules_match(struct Client *c, struct rule_match *match);
+
+void rules_place(struct Client *c, const struct rule_match *match, struct Monitor *m);
+
+void rules_configure(struct Client *c);
+
 void setfullscreen(struct Client *c, int fullscreen);
 
 #include "listeners.h"